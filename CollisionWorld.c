@@ -25,22 +25,155 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <inttypes.h>
 #include <assert.h>
 #include <stdio.h>
-#include <cilk/cilk.h>
-#include <cilk/reducer_opadd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "./IntersectionDetection.h"
 #include "./IntersectionEventList.h"
+#include "./EventLog.h"
+#include "./Kinetic.h"
 #include "./Line.h"
+#include "./LineTable.h"
+#include "./PairList.h"
+#include "./Parallel.h"
+#include "./PerfCounters.h"
+#include "./PhaseTiming.h"
 #include "./Quadtree.h"
+#include "./Query.h"
+#include "./StaticIndex.h"
+#include "./Trace.h"
 
-// Coarsening for computing intersection in parallel
-#define INTERSECT_COARSE_LIM 20
+// The traversal is split into about this many tasks per worker, but no task
+// is planned with fewer than TRAVERSE_MIN_TASK_WORK pair tests.
+#define TRAVERSE_TASKS_PER_WORKER 8
+#define TRAVERSE_MIN_TASK_WORK 4096
 
+// Each task of CollisionWorld_getIntersectionEventsFromPairs tests this many
+// candidate pairs.
+#define PAIR_TASK_SIZE 4096
 
-CollisionWorld* CollisionWorld_new(const unsigned int capacity) {
+// Each task of the static index queries handles this many dynamic lines.
+#define STATIC_QUERY_TASK_SIZE 256
+
+// Lines are ordered along a Hilbert curve through a grid of this many cells
+// per side over the box, by the cell of their midpoints.  Must be a power
+// of 2.
+#define HILBERT_SIDE 1024
+
+// Arguments of a quadtree_insert_lines task.
+struct InsertLinesArgs {
+  quad_tree* tree;
+  line_node* lines;
+  double timeStep;
+  size_t num_lines;
+  Line** span;
+};
+typedef struct InsertLinesArgs InsertLinesArgs;
+
+static void insertLinesTask(void* arg) {
+  InsertLinesArgs* args = arg;
+  quadtree_insert_lines(args->tree, args->lines, args->timeStep,
+                        args->num_lines, args->span);
+}
+
+// A subtree that one traversal task handles whole, with the lines stored in
+// its ancestors that may reach it.
+struct TraversalSubtree {
+  quad_tree* tree;
+  const LineSpan* upstream;
+};
+typedef struct TraversalSubtree TraversalSubtree;
+
+// A task of the traversal.  It either tests rows
+// [first_row, first_row + num_rows) of a heavy node's num_own lines, or
+// handles the subtrees [first_subtree, last_subtree) of the plan whole.
+struct TraversalTask {
+  Line** own;
+  size_t num_own;
+  size_t first_row;
+  size_t num_rows;
+  const LineSpan* upstream;
+  size_t first_subtree;
+  size_t last_subtree;
+  IntersectionEventList result;
+};
+typedef struct TraversalTask TraversalTask;
+
+// Spans made by culling for one child: the top num_made spans of the stack.
+struct MadeSpans {
+  const LineSpan* spans;
+  size_t num_made;
+};
+typedef struct MadeSpans MadeSpans;
+
+struct TraversalPlan {
+  double timeStep;
+  PairTestCounters* counters;
+  // Work, in pair tests, that a task should get.
+  unsigned long long target_work;
+  TraversalSubtree* subtrees;
+  size_t num_subtrees;
+  TraversalTask* tasks;
+  size_t num_tasks;
+  // The light subtrees planned since the last subtree task was closed.
+  size_t batch_begin;
+  unsigned long long batch_work;
+  // Spans of the heavy nodes' own lines, and the spans culled for their
+  // children, which live until the traversal is done.
+  LineSpan* own_spans;
+  size_t num_own_spans;
+  MadeSpans* made;
+  size_t num_made;
+};
+typedef struct TraversalPlan TraversalPlan;
+
+
+// Initializes the storage of lines [begin, end).  Since this is the first
+// write to the storage, each block's pages are placed on the NUMA node of
+// the worker that runs it.
+static void touchLines(size_t begin, size_t end, void* arg) {
+  CollisionWorld* collisionWorld = arg;
+  for (size_t i = begin; i < end; i++) {
+    Line* line = &collisionWorld->lineStorage[i];
+    line_node* node = &collisionWorld->lineNodeStorage[i];
+    memset(line, 0, sizeof(Line));
+    node->line = line;
+    node->next = NULL;
+    collisionWorld->lines[i] = line;
+    collisionWorld->line_nodes[i] = node;
+  }
+}
+
+struct CopyLinesArgs {
+  CollisionWorld* collisionWorld;
+  const Line* lines;
+};
+typedef struct CopyLinesArgs CopyLinesArgs;
+
+// Copies the lines over the same blocks as touchLines.
+static void copyLinesBlock(size_t begin, size_t end, void* arg) {
+  CopyLinesArgs* args = arg;
+  size_t numOfLines = args->collisionWorld->numOfLines;
+  if (end > numOfLines) {
+    end = numOfLines;
+  }
+  if (begin < end) {
+    memcpy(&args->collisionWorld->lineStorage[begin], &args->lines[begin],
+           (end - begin) * sizeof(Line));
+  }
+}
+
+CollisionWorld* CollisionWorld_new(const size_t capacity) {
   assert(capacity > 0);
+  if (capacity > SIZE_MAX / sizeof(Line)) {
+    return NULL;
+  }
 
   CollisionWorld* collisionWorld = malloc(sizeof(CollisionWorld));
   if (collisionWorld == NULL) {
@@ -49,18 +182,98 @@ CollisionWorld* CollisionWorld_new(const unsigned int capacity) {
 
   collisionWorld->numLineWallCollisions = 0;
   collisionWorld->numLineLineCollisions = 0;
+  collisionWorld->frameCount = 0;
+  collisionWorld->verifyBroadphase = false;
+  collisionWorld->numBroadphaseMismatches = 0;
   collisionWorld->timeStep = 0.5;
   collisionWorld->lines = malloc(capacity * sizeof(Line*));
   collisionWorld->line_nodes = malloc(capacity * sizeof(line_node*));
+  collisionWorld->lineStorage = malloc(capacity * sizeof(Line));
+  collisionWorld->lineNodeStorage = malloc(capacity * sizeof(line_node));
+  collisionWorld->treeLines = malloc(capacity * sizeof(Line*));
+  collisionWorld->hashLines = malloc(capacity * sizeof(Line*));
+  collisionWorld->queryTree = NULL;
+  collisionWorld->broadphase = BROADPHASE_QUADTREE;
+  collisionWorld->pairList = PairList_new(capacity);
+  collisionWorld->kinetic = false;
+  collisionWorld->kineticEngine = KineticEngine_new(capacity);
+  collisionWorld->linesLag = false;
+  collisionWorld->staticPartition = true;
+  collisionWorld->staticIndex = StaticIndex_new(capacity);
+  collisionWorld->dynamicNodes = malloc(capacity * sizeof(line_node*));
   collisionWorld->numOfLines = 0;
+  collisionWorld->capacity = capacity;
+  collisionWorld->lineTable = LineTable_new(capacity);
+  collisionWorld->nextLineId = 0;
+  collisionWorld->reorderInterval = REORDER_INTERVAL;
+  collisionWorld->numReorders = 0;
+  memset(&collisionWorld->frameStats, 0, sizeof(CollisionWorldFrameStats));
+  collisionWorld->pairTestCounters = NULL;
+  collisionWorld->numPairTestCounters = 0;
+  collisionWorld->eventCallback = NULL;
+  collisionWorld->eventCallbackArg = NULL;
+  collisionWorld->events = NULL;
+  collisionWorld->numEvents = 0;
+  collisionWorld->eventCapacity = 0;
+  collisionWorld->deferEvents = false;
+  collisionWorld->eventLog = NULL;
+  collisionWorld->replayLog = NULL;
+  if (collisionWorld->lines == NULL || collisionWorld->line_nodes == NULL
+      || collisionWorld->lineStorage == NULL
+      || collisionWorld->lineNodeStorage == NULL
+      || collisionWorld->treeLines == NULL
+      || collisionWorld->hashLines == NULL
+      || collisionWorld->pairList == NULL
+      || collisionWorld->kineticEngine == NULL
+      || collisionWorld->staticIndex == NULL
+      || collisionWorld->dynamicNodes == NULL
+      || collisionWorld->lineTable == NULL) {
+    CollisionWorld_delete(collisionWorld);
+    return NULL;
+  }
+  Parallel_forStatic(capacity, touchLines, collisionWorld);
   return collisionWorld;
 }
 
-void CollisionWorld_delete(CollisionWorld* collisionWorld) {
-  for (int i = 0; i < collisionWorld->numOfLines; i++) {
-    free(collisionWorld->lines[i]);
-    free(collisionWorld->line_nodes[i]);
+CollisionWorld* CollisionWorld_newFromArrays(const size_t numLines,
+                                             const Vec* p1, const Vec* p2,
+                                             const Vec* velocities,
+                                             const Color* colors) {
+  CollisionWorld* collisionWorld = CollisionWorld_new(numLines);
+  if (collisionWorld == NULL) {
+    return NULL;
+  }
+  // The line table was made for numLines IDs, so it never has to grow here.
+  for (size_t i = 0; i < numLines; i++) {
+    Line* line = collisionWorld->lines[i];
+    line->p1 = p1[i];
+    line->p2 = p2[i];
+    line->max_x_is_p1 = (line->p1.x > line->p2.x);
+    line->max_y_is_p1 = (line->p1.y > line->p2.y);
+    line->velocity = velocities[i];
+    line->color = (colors != NULL) ? colors[i] : RED;
+    line->id = i;
+    update_box(line, collisionWorld->timeStep);
+    LineTable_set(collisionWorld->lineTable, i, i);
   }
+  collisionWorld->numOfLines = numLines;
+  collisionWorld->nextLineId = numLines;
+  return collisionWorld;
+}
+
+static void dropQueryTree(CollisionWorld* collisionWorld);
+
+void CollisionWorld_delete(CollisionWorld* collisionWorld) {
+  dropQueryTree(collisionWorld);
+  free(collisionWorld->lineStorage);
+  free(collisionWorld->lineNodeStorage);
+  free(collisionWorld->treeLines);
+  free(collisionWorld->hashLines);
+  LineTable_delete(collisionWorld->lineTable);
+  PairList_delete(collisionWorld->pairList);
+  KineticEngine_delete(collisionWorld->kineticEngine);
+  StaticIndex_delete(collisionWorld->staticIndex);
+  free(collisionWorld->dynamicNodes);
   free(collisionWorld->lines);
   /*
   line_node * cur, * prev;
@@ -72,37 +285,398 @@ void CollisionWorld_delete(CollisionWorld* collisionWorld) {
   }
   */
   free(collisionWorld->line_nodes);
+  free(collisionWorld->pairTestCounters);
+  free(collisionWorld->events);
   free(collisionWorld);
 }
 
-unsigned int CollisionWorld_getNumOfLines(CollisionWorld* collisionWorld) {
+size_t CollisionWorld_getNumOfLines(CollisionWorld* collisionWorld) {
   return collisionWorld->numOfLines;
 }
 
-void CollisionWorld_addLine(CollisionWorld* collisionWorld, Line *line) {
-  collisionWorld->lines[collisionWorld->numOfLines] = line;
-  collisionWorld->line_nodes[collisionWorld->numOfLines] = line_node_new(line);
+bool CollisionWorld_reserve(CollisionWorld* collisionWorld,
+                            const size_t capacity) {
+  if (capacity <= collisionWorld->capacity) {
+    return true;
+  }
+  if (capacity > SIZE_MAX / sizeof(Line)) {
+    return false;
+  }
+
+  // The persistent broadphase structures index the lines by slot, so they
+  // only need room for the new lines.  They grow first, since a larger
+  // structure does no harm if the world then cannot grow.
+  if (!PairList_grow(collisionWorld->pairList, capacity)
+      || !KineticEngine_grow(collisionWorld->kineticEngine, capacity)
+      || !StaticIndex_grow(collisionWorld->staticIndex, capacity)) {
+    return false;
+  }
+  Line** lines = malloc(capacity * sizeof(Line*));
+  line_node** lineNodes = malloc(capacity * sizeof(line_node*));
+  Line* lineStorage = malloc(capacity * sizeof(Line));
+  line_node* lineNodeStorage = malloc(capacity * sizeof(line_node));
+  Line** treeLines = malloc(capacity * sizeof(Line*));
+  Line** hashLines = malloc(capacity * sizeof(Line*));
+  line_node** dynamicNodes = malloc(capacity * sizeof(line_node*));
+  if (lines == NULL || lineNodes == NULL || lineStorage == NULL
+      || lineNodeStorage == NULL || treeLines == NULL || hashLines == NULL
+      || dynamicNodes == NULL) {
+    free(lines);
+    free(lineNodes);
+    free(lineStorage);
+    free(lineNodeStorage);
+    free(treeLines);
+    free(hashLines);
+    free(dynamicNodes);
+    return false;
+  }
+
+  dropQueryTree(collisionWorld);
+  Line* oldStorage = collisionWorld->lineStorage;
+  free(collisionWorld->lines);
+  free(collisionWorld->line_nodes);
+  free(collisionWorld->lineNodeStorage);
+  free(collisionWorld->treeLines);
+  free(collisionWorld->hashLines);
+  free(collisionWorld->dynamicNodes);
+  collisionWorld->lines = lines;
+  collisionWorld->line_nodes = lineNodes;
+  collisionWorld->lineStorage = lineStorage;
+  collisionWorld->lineNodeStorage = lineNodeStorage;
+  collisionWorld->treeLines = treeLines;
+  collisionWorld->hashLines = hashLines;
+  collisionWorld->dynamicNodes = dynamicNodes;
+  collisionWorld->capacity = capacity;
+
+  // The new storage is first touched over the new blocks, then the lines
+  // are copied over, still contiguous and in the same slots.
+  Parallel_forStatic(capacity, touchLines, collisionWorld);
+  CopyLinesArgs args = { collisionWorld, oldStorage };
+  Parallel_forStatic(capacity, copyLinesBlock, &args);
+  free(oldStorage);
+
+  // The broadphase structures then only need the new addresses of the lines.
+  PairList_rebase(collisionWorld->pairList, collisionWorld->lines);
+  StaticIndex* index = collisionWorld->staticIndex;
+  StaticIndex_rebase(index, collisionWorld->lines);
+  if (index->valid) {
+    for (size_t d = 0; d < index->numDynamic; d++) {
+      collisionWorld->dynamicNodes[d] =
+          collisionWorld->line_nodes[index->dynamicLines[d]];
+    }
+  }
+  return true;
+}
+
+bool CollisionWorld_addLine(CollisionWorld* collisionWorld, Line *line) {
+  assert(LineTable_find(collisionWorld->lineTable, line->id)
+         == LINE_TABLE_NONE);
+  size_t i = collisionWorld->numOfLines;
+  if (!LineTable_set(collisionWorld->lineTable, line->id, i)) {
+    return false;
+  }
+  if (i == collisionWorld->capacity) {
+    size_t capacity = (collisionWorld->capacity <= SIZE_MAX / 2)
+        ? 2 * collisionWorld->capacity : SIZE_MAX;
+    if (!CollisionWorld_reserve(collisionWorld, capacity)) {
+      LineTable_remove(collisionWorld->lineTable, line->id);
+      return false;
+    }
+  }
+  *collisionWorld->lines[i] = *line;
+  free(line);
+  dropQueryTree(collisionWorld);
   collisionWorld->numOfLines++;
+  if (collisionWorld->linesLag) {
+    collisionWorld->kineticEngine->positionFrames[i] =
+        collisionWorld->frameCount;
+  }
+
+  Line* added = collisionWorld->lines[i];
+  if (added->id >= collisionWorld->nextLineId) {
+    collisionWorld->nextLineId = added->id + 1;
+  }
+
+  // The line joins a valid static index as a dynamic line.  The PairList
+  // and the KineticEngine are extended at the next frame.
+  StaticIndex* index = collisionWorld->staticIndex;
+  if (StaticIndex_isValid(index, i)) {
+    StaticIndex_addLine(index, collisionWorld->numOfLines);
+    collisionWorld->dynamicNodes[index->numDynamic - 1] =
+        collisionWorld->line_nodes[i];
+  }
+  return true;
+}
+
+bool CollisionWorld_insertLine(CollisionWorld* collisionWorld, Vec p1, Vec p2,
+                               Vec velocity, Color color, uint64_t* id) {
+  Line* line = malloc(sizeof(Line));
+  if (line == NULL) {
+    return false;
+  }
+  memset(line, 0, sizeof(Line));
+  line->p1 = p1;
+  line->p2 = p2;
+  line->max_x_is_p1 = (p1.x > p2.x);
+  line->max_y_is_p1 = (p1.y > p2.y);
+  line->velocity = velocity;
+  line->color = color;
+  line->id = collisionWorld->nextLineId;
+  if (!CollisionWorld_addLine(collisionWorld, line)) {
+    free(line);
+    return false;
+  }
+  *id = collisionWorld->nextLineId - 1;
+  return true;
+}
+
+bool CollisionWorld_removeLine(CollisionWorld* collisionWorld, uint64_t id) {
+  LineTable* table = collisionWorld->lineTable;
+  size_t i = LineTable_find(table, id);
+  if (i == LINE_TABLE_NONE) {
+    return false;
+  }
+  LineTable_remove(table, id);
+  size_t last = --collisionWorld->numOfLines;
+  if (i != last) {
+    *collisionWorld->lines[i] = *collisionWorld->lines[last];
+    LineTable_set(table, collisionWorld->lines[i]->id, i);
+    KineticEngine* engine = collisionWorld->kineticEngine;
+    engine->positionFrames[i] = engine->positionFrames[last];
+  }
+  dropQueryTree(collisionWorld);
+
+  // The structures that index the lines by slot drop the line and move the
+  // last line's entries into its slot, as addLine appends to them.
+  PairList_removeLine(collisionWorld->pairList, collisionWorld->lines, i,
+                      last);
+  KineticEngine_removeLine(collisionWorld->kineticEngine,
+                           collisionWorld->pairList, i, last);
+  StaticIndex* index = collisionWorld->staticIndex;
+  StaticIndex_removeLine(index, i, last);
+  if (StaticIndex_isValid(index, last)) {
+    for (size_t d = 0; d < index->numDynamic; d++) {
+      collisionWorld->dynamicNodes[d] =
+          collisionWorld->line_nodes[index->dynamicLines[d]];
+    }
+  }
+  return true;
+}
+
+// Brings line index up to date if the KineticEngine left it behind.
+static inline Line* settleLine(CollisionWorld* collisionWorld, size_t index) {
+  if (collisionWorld->linesLag) {
+    KineticEngine_advance(collisionWorld->kineticEngine, collisionWorld->lines,
+                          index, collisionWorld->timeStep,
+                          collisionWorld->frameCount);
+  }
+  return collisionWorld->lines[index];
+}
+
+struct SettleLinesArgs {
+  CollisionWorld* collisionWorld;
+  uint64_t frame;
+};
+typedef struct SettleLinesArgs SettleLinesArgs;
+
+static void settleLinesBlock(size_t begin, size_t end, void* arg) {
+  SettleLinesArgs* args = arg;
+  CollisionWorld* collisionWorld = args->collisionWorld;
+  if (end > collisionWorld->numOfLines) {
+    end = collisionWorld->numOfLines;
+  }
+  for (size_t i = begin; i < end; i++) {
+    KineticEngine_advance(collisionWorld->kineticEngine, collisionWorld->lines,
+                          i, collisionWorld->timeStep, args->frame);
+  }
+}
+
+// Brings every line the KineticEngine left behind to its position at the
+// start of frame.
+static void settleLines(CollisionWorld* collisionWorld, uint64_t frame) {
+  if (collisionWorld->linesLag) {
+    SettleLinesArgs args = { collisionWorld, frame };
+    Parallel_forStatic(collisionWorld->capacity, settleLinesBlock, &args);
+  }
+}
+
+// Brings every line up to date and stops them lagging, for the code that
+// moves them all.
+static void catchUpLines(CollisionWorld* collisionWorld) {
+  settleLines(collisionWorld, collisionWorld->frameCount);
+  collisionWorld->linesLag = false;
 }
 
 Line* CollisionWorld_getLine(CollisionWorld* collisionWorld,
-                             const unsigned int index) {
+                             const size_t index) {
   if (index >= collisionWorld->numOfLines) {
     return NULL;
   }
-  return collisionWorld->lines[index];
+  return settleLine(collisionWorld, index);
+}
+
+Line* CollisionWorld_findLine(CollisionWorld* collisionWorld, uint64_t id) {
+  size_t i = LineTable_find(collisionWorld->lineTable, id);
+  return (i != LINE_TABLE_NONE) ? settleLine(collisionWorld, i) : NULL;
+}
+
+static bool updateLinesKinetic(CollisionWorld* collisionWorld);
+static bool replayEvents(CollisionWorld* collisionWorld);
+static void reorderLines(CollisionWorld* collisionWorld);
+
+// Hands the buffered events to the callback.
+static void deliverEvents(CollisionWorld* collisionWorld) {
+  if (collisionWorld->numEvents > 0) {
+    collisionWorld->eventCallback(collisionWorld->events,
+                                  collisionWorld->numEvents,
+                                  collisionWorld->eventCallbackArg);
+    collisionWorld->numEvents = 0;
+  }
 }
 
 void CollisionWorld_updateLines(CollisionWorld* collisionWorld) {
-  CollisionWorld_detectIntersection(collisionWorld);
-  CollisionWorld_updatePosition(collisionWorld);
-  CollisionWorld_lineWallCollision(collisionWorld);
+  dropQueryTree(collisionWorld);
+  // The other ways of simulating a frame move every line.
+  if (collisionWorld->replayLog != NULL || !collisionWorld->kinetic) {
+    catchUpLines(collisionWorld);
+  }
+  if (collisionWorld->replayLog != NULL && replayEvents(collisionWorld)) {
+    PHASE_BEGIN(PHASE_UPDATE_POSITION);
+    CollisionWorld_updatePosition(collisionWorld);
+    PHASE_END(PHASE_UPDATE_POSITION);
+    PHASE_BEGIN(PHASE_WALL);
+    CollisionWorld_lineWallCollision(collisionWorld);
+    PHASE_END(PHASE_WALL);
+  } else if (collisionWorld->kinetic && updateLinesKinetic(collisionWorld)) {
+    // The KineticEngine simulated the frame.
+  } else {
+    CollisionWorld_detectIntersection(collisionWorld);
+    PHASE_BEGIN(PHASE_UPDATE_POSITION);
+    CollisionWorld_updatePosition(collisionWorld);
+    PHASE_END(PHASE_UPDATE_POSITION);
+    PHASE_BEGIN(PHASE_WALL);
+    CollisionWorld_lineWallCollision(collisionWorld);
+    PHASE_END(PHASE_WALL);
+  }
+  if (collisionWorld->reorderInterval > 0
+      && (collisionWorld->frameCount + 1)
+          % collisionWorld->reorderInterval == 0) {
+    PHASE_BEGIN(PHASE_BUILD);
+    reorderLines(collisionWorld);
+    PHASE_END(PHASE_BUILD);
+  }
+  PHASE_END_FRAME();
+  collisionWorld->frameCount++;
+  if (!collisionWorld->deferEvents) {
+    deliverEvents(collisionWorld);
+  }
 }
 
-void CollisionWorld_updatePosition(CollisionWorld* collisionWorld) {
+// Lets the KineticEngine's lines lag behind from the current frame on.
+static void lagLines(CollisionWorld* collisionWorld) {
+  if (!collisionWorld->linesLag) {
+    KineticEngine* engine = collisionWorld->kineticEngine;
+    for (size_t i = 0; i < collisionWorld->numOfLines; i++) {
+      engine->positionFrames[i] = collisionWorld->frameCount;
+    }
+    collisionWorld->linesLag = true;
+  }
+}
+
+// Moves the frame count on, up to lastFrame, over the frames in which the
+// KineticEngine has nothing to do.  Frames that write the event log or are
+// verified are all simulated, as is the frame that checks the storage order.
+static void skipIdleFrames(CollisionWorld* collisionWorld,
+                           uint64_t lastFrame) {
+  KineticEngine* engine = collisionWorld->kineticEngine;
+  size_t numOfLines = collisionWorld->numOfLines;
+  if (!collisionWorld->kinetic || collisionWorld->replayLog != NULL
+      || collisionWorld->eventLog != NULL || collisionWorld->verifyBroadphase
+      || !engine->built || engine->numLines != numOfLines
+      || collisionWorld->pairList->numLines != numOfLines) {
+    return;
+  }
+  uint64_t frame = collisionWorld->frameCount;
+  uint64_t next = KineticEngine_nextDueFrame(engine);
+  if (next > lastFrame) {
+    next = lastFrame;
+  }
+  uint64_t interval = collisionWorld->reorderInterval;
+  if (interval > 0 && next > (frame / interval + 1) * interval - 1) {
+    next = (frame / interval + 1) * interval - 1;
+  }
+  if (next <= frame) {
+    return;
+  }
+  lagLines(collisionWorld);
+  dropQueryTree(collisionWorld);
+  CollisionWorldFrameStats* stats = &collisionWorld->frameStats;
+  size_t numCandidatePairs = stats->numCandidatePairs;
+  uint64_t numPairListBuilds = stats->numPairListBuilds;
+  unsigned long long numQueuedEvents = stats->numQueuedEvents;
+  uint64_t numReorders = stats->numReorders;
+  memset(stats, 0, sizeof(CollisionWorldFrameStats));
+  stats->numCandidatePairs = numCandidatePairs;
+  stats->numPairListBuilds = numPairListBuilds;
+  stats->numQueuedEvents = numQueuedEvents;
+  stats->numReorders = numReorders;
+  collisionWorld->frameCount = next;
+}
+
+void CollisionWorld_step(CollisionWorld* collisionWorld,
+                         const uint64_t numFrames) {
+  collisionWorld->deferEvents = true;
+  uint64_t lastFrame = collisionWorld->frameCount + numFrames;
+  while (collisionWorld->frameCount < lastFrame) {
+    skipIdleFrames(collisionWorld, lastFrame);
+    if (collisionWorld->frameCount < lastFrame) {
+      CollisionWorld_updateLines(collisionWorld);
+    }
+  }
+  collisionWorld->deferEvents = false;
+  deliverEvents(collisionWorld);
+}
+
+void CollisionWorld_setEventLog(CollisionWorld* collisionWorld,
+                                EventLog* log) {
+  assert(log == NULL || (log->writing
+                         && log->numLines == collisionWorld->numOfLines
+                         && log->firstFrame == collisionWorld->frameCount));
+  collisionWorld->eventLog = log;
+}
+
+bool CollisionWorld_setReplay(CollisionWorld* collisionWorld, EventLog* log) {
+  collisionWorld->replayLog = NULL;
+  if (log == NULL) {
+    return true;
+  }
+  if (log->writing || log->numLines != collisionWorld->numOfLines
+      || log->firstFrame != collisionWorld->frameCount) {
+    return false;
+  }
+  collisionWorld->replayLog = log;
+  return true;
+}
+
+void CollisionWorld_setEventCallback(CollisionWorld* collisionWorld,
+                                     CollisionWorldEventCallback callback,
+                                     void* arg) {
+  collisionWorld->eventCallback = callback;
+  collisionWorld->eventCallbackArg = arg;
+  collisionWorld->numEvents = 0;
+}
+
+// The per-line loops below are split over the same blocks as touchLines, so
+// each worker updates lines on its own NUMA node.  Blocks past numOfLines
+// are empty when the world is not full.
+static void updatePositionBlock(size_t begin, size_t end, void* arg) {
+  CollisionWorld* collisionWorld = arg;
   double t = collisionWorld->timeStep;
   Vec displacement;
-  for (int i = 0; i < collisionWorld->numOfLines; i++) {
+  if (end > collisionWorld->numOfLines) {
+    end = collisionWorld->numOfLines;
+  }
+  for (size_t i = begin; i < end; i++) {
     Line *line = collisionWorld->lines[i];
     displacement = Vec_multiply(line->velocity, t);
     line->p1 = Vec_add(line->p1, displacement);
@@ -110,17 +684,81 @@ void CollisionWorld_updatePosition(CollisionWorld* collisionWorld) {
   }
 }
 
-// Puts all points in the given collision_world into a quad_tree and
-// returns the quad_tree.
-quad_tree* build_quadtree(CollisionWorld* collision_world) {
+void CollisionWorld_updatePosition(CollisionWorld* collisionWorld) {
+  catchUpLines(collisionWorld);
+  Parallel_forStatic(collisionWorld->capacity, updatePositionBlock,
+                     collisionWorld);
+}
+
+// Reverses the line's velocity along each axis where it is past a wall and
+// moving further out.  Returns whether it collided with any wall.
+static bool bounceOffWalls(Line* line) {
+  bool collide = false;
+
+  // Right side
+  if ((line->p1.x > BOX_XMAX || line->p2.x > BOX_XMAX)
+      && (line->velocity.x > 0)) {
+    line->velocity.x = -line->velocity.x;
+    collide = true;
+  }
+  // Left side
+  if ((line->p1.x < BOX_XMIN || line->p2.x < BOX_XMIN)
+      && (line->velocity.x < 0)) {
+    line->velocity.x = -line->velocity.x;
+    collide = true;
+  }
+  // Top side
+  if ((line->p1.y > BOX_YMAX || line->p2.y > BOX_YMAX)
+      && (line->velocity.y > 0)) {
+    line->velocity.y = -line->velocity.y;
+    collide = true;
+  }
+  // Bottom side
+  if ((line->p1.y < BOX_YMIN || line->p2.y < BOX_YMIN)
+      && (line->velocity.y < 0)) {
+    line->velocity.y = -line->velocity.y;
+    collide = true;
+  }
+  return collide;
+}
+
+static void lineWallCollisionBlock(size_t begin, size_t end, void* arg) {
+  CollisionWorld* collisionWorld = arg;
+  uint64_t numCollisions = 0;
+  if (end > collisionWorld->numOfLines) {
+    end = collisionWorld->numOfLines;
+  }
+  for (size_t i = begin; i < end; i++) {
+    // Update total number of collisions.
+    if (bounceOffWalls(collisionWorld->lines[i])) {
+      numCollisions++;
+    }
+  }
+  __atomic_fetch_add(&collisionWorld->numLineWallCollisions, numCollisions,
+                     __ATOMIC_RELAXED);
+}
+
+void CollisionWorld_lineWallCollision(CollisionWorld* collisionWorld) {
+  catchUpLines(collisionWorld);
+  Parallel_forStatic(collisionWorld->capacity, lineWallCollisionBlock,
+                     collisionWorld);
+}
+
+// Puts the num_nodes lines of nodes into a quad_tree and returns the
+// quad_tree.
+static quad_tree* buildQuadtreeOver(CollisionWorld* collision_world,
+                                    line_node** nodes, size_t num_nodes) {
   quad_tree* tree = quad_tree_new(BOX_XMIN, BOX_XMAX, BOX_YMIN, BOX_YMAX);
-  tree->num_lines = collision_world->numOfLines;
+  tree->num_lines = num_nodes;
+  Line** span = collision_world->treeLines;
+  tree->lines = span;
 
   // Insert all the lines into the root of the tree if total number of
   // lines is less than N
   if (tree->num_lines <= N) {
-    for (int i = 0; i < collision_world->numOfLines; ++i) {
-      insert_line(&tree->lines, collision_world->line_nodes[i]);
+    for (size_t i = 0; i < num_nodes; ++i) {
+      update_box(nodes[i]->line, collision_world->timeStep);
+      span[tree->num_own_lines++] = nodes[i]->line;
     }
     return tree;
   }
@@ -128,19 +766,20 @@ quad_tree* build_quadtree(CollisionWorld* collision_world) {
   // quad1, quad2, quad3, quad4 store all line segments that can be completely
   // inserted into smaller quad_trees contained in the given quad_tree.
   //
-  // lines contains all line segments that cannot be completely inserted into
-  // a single sub-quad_tree of the given quad_tree.
-  line_node *quad1, *quad2, *quad3, *quad4, *lines;
-  quad1 = quad2 = quad3 = quad4 = lines = NULL;
-  int num_quad1, num_quad2, num_quad3, num_quad4;
+  // span starts with all line segments that cannot be completely inserted
+  // into a single sub-quad_tree of the given quad_tree, and each
+  // quadrant's lines follow them.
+  line_node *quad1, *quad2, *quad3, *quad4;
+  quad1 = quad2 = quad3 = quad4 = NULL;
+  size_t num_quad1, num_quad2, num_quad3, num_quad4;
   num_quad1 = num_quad2 = num_quad3 = num_quad4 = 0;
 
   // Iterate through all line segments contained in the current quad_tree, and determine
   // which sub-quad_tree a line segment can be inserted into, if any exists.
   int type;
-  for (int i = 0; i < collision_world->numOfLines; i++) {
-    update_box(collision_world->lines[i], collision_world->timeStep);
-    line_node* ptr_node = collision_world->line_nodes[i];
+  for (size_t i = 0; i < num_nodes; i++) {
+    line_node* ptr_node = nodes[i];
+    update_box(ptr_node->line, collision_world->timeStep);
     type = get_quad_type(tree, ptr_node, collision_world->timeStep);
     switch (type) {
       case Q1_TYPE:
@@ -160,7 +799,7 @@ quad_tree* build_quadtree(CollisionWorld* collision_world) {
         num_quad4++;
         break;
       case MUL_TYPE:
-        insert_line(&lines, ptr_node);
+        span[tree->num_own_lines++] = ptr_node->line;
         break;
       default:
         return NULL;
@@ -171,47 +810,440 @@ quad_tree* build_quadtree(CollisionWorld* collision_world) {
   double X_MID = (BOX_XMAX + BOX_XMIN) / 2.0;
   double Y_MID = (BOX_YMAX + BOX_YMIN) / 2.0;
 
-  tree->lines = lines;
+  span += tree->num_own_lines;
 
+  // Each non-empty quadrant is filled in by its own task.
+  InsertLinesArgs tasks[4];
+  int num_tasks = 0;
   if (quad1) {
     tree->quad1 = quad_tree_new(BOX_XMIN, X_MID, BOX_YMIN, Y_MID);
-    cilk_spawn quadtree_insert_lines(tree->quad1, quad1, collision_world->timeStep, num_quad1);
+    tasks[num_tasks++] = (InsertLinesArgs) { tree->quad1, quad1,
+        collision_world->timeStep, num_quad1, span };
+    span += num_quad1;
   }
   if (quad2) {
     tree->quad2 = quad_tree_new(X_MID, BOX_XMAX, BOX_YMIN, Y_MID);
-    cilk_spawn quadtree_insert_lines(tree->quad2, quad2, collision_world->timeStep, num_quad2);
+    tasks[num_tasks++] = (InsertLinesArgs) { tree->quad2, quad2,
+        collision_world->timeStep, num_quad2, span };
+    span += num_quad2;
   }
   if (quad3) {
     tree->quad3 = quad_tree_new(BOX_XMIN, X_MID, Y_MID, BOX_YMAX);
-    cilk_spawn quadtree_insert_lines(tree->quad3, quad3, collision_world->timeStep, num_quad3);
+    tasks[num_tasks++] = (InsertLinesArgs) { tree->quad3, quad3,
+        collision_world->timeStep, num_quad3, span };
+    span += num_quad3;
   }
   if (quad4) {
-    // Note: We do not cilk_spawn here since if we cilk_spawn, the current thread
-    // will be wasted waiting for all the other threads to complete
     tree->quad4 = quad_tree_new(X_MID, BOX_XMAX, Y_MID, BOX_YMAX);
-    quadtree_insert_lines(tree->quad4, quad4, collision_world->timeStep, num_quad4);
+    tasks[num_tasks++] = (InsertLinesArgs) { tree->quad4, quad4,
+        collision_world->timeStep, num_quad4, span };
   }
+  // Note: The last task runs on the current thread rather than being
+  // spawned, since the current thread would otherwise sit waiting for the
+  // others to complete.
+  Parallel_invoke(insertLinesTask, tasks, sizeof(InsertLinesArgs), num_tasks);
 
   return tree;
 }
 
+// Puts all points in the given collision_world into a quad_tree and
+// returns the quad_tree.
+quad_tree* build_quadtree(CollisionWorld* collision_world) {
+  return buildQuadtreeOver(collision_world, collision_world->line_nodes,
+                           collision_world->numOfLines);
+}
+
+static inline void testPair(Line* l1, Line* l2, double timeStep,
+                            IntersectionEventList* intersectionEventList,
+                            PairTestCounters* tally) {
+  // intersect expects compareLines(l1, l2) < 0 to be true.
+  // Swap l1 and l2, if necessary.
+  if (compareLines(l1, l2) >= 0) {
+    Line *temp = l1;
+    l1 = l2;
+    l2 = temp;
+  }
+  if (tally != NULL) {
+    tally->numIntersectCalls++;
+    tally->numBoxRejections += !rectangles_overlap(l1, l2);
+  }
+  IntersectionType intersectionType = intersect(l1, l2, timeStep);
+  if (intersectionType != NO_INTERSECTION) {
+    IntersectionEventList_appendNode(intersectionEventList, l1, l2,
+                                     intersectionType);
+  }
+}
+
+// Tests own line i against the own lines after it and against every
+// upstream line.  If tally is not NULL, the pair tests are counted in it.
+static void testRow(Line** own, size_t num_own, size_t i,
+                    const LineSpan* upstream, double timeStep,
+                    IntersectionEventList* intersectionEventList,
+                    PairTestCounters* tally) {
+  for (size_t j = i + 1; j < num_own; j++) {
+    testPair(own[i], own[j], timeStep, intersectionEventList, tally);
+  }
+  for (const LineSpan* span = upstream; span != NULL; span = span->next) {
+    for (size_t j = 0; j < span->num_lines; j++) {
+      testPair(own[i], span->lines[j], timeStep, intersectionEventList,
+               tally);
+    }
+  }
+}
+
+static size_t countSpans(const LineSpan* spans) {
+  size_t num_lines = 0;
+  for (const LineSpan* span = spans; span != NULL; span = span->next) {
+    num_lines += span->num_lines;
+  }
+  return num_lines;
+}
+
+// Whether the line's swept box reaches the region whose lines the given
+// quad_tree stores.  Lines in a child lie strictly on one side of each
+// ancestor's midlines, so a line whose box misses that region cannot pass
+// the box test of intersect with any of them.  Sides on the box boundary
+// are left open, since lines may leave the box before bouncing back.
+static inline bool reachesNode(Line* line, quad_tree* tree) {
+  return (tree->xmin <= BOX_XMIN || line->u_x >= tree->xmin)
+      && (tree->xmax >= BOX_XMAX || line->l_x <= tree->xmax)
+      && (tree->ymin <= BOX_YMIN || line->u_y >= tree->ymin)
+      && (tree->ymax >= BOX_YMAX || line->l_y <= tree->ymax);
+}
+
+static void freeSpans(const LineSpan* spans, size_t num_made) {
+  for (size_t i = 0; i < num_made; i++) {
+    const LineSpan* next = spans->next;
+    free((LineSpan*) spans);
+    spans = next;
+  }
+}
+
+// Culls the stack of spans to the lines that reach child.  A span that keeps
+// all its lines, along with every span under it, is shared rather than
+// copied, and a span that keeps none is dropped.  The spans made here are
+// the top *num_made spans of the returned stack.  If a span cannot be
+// allocated, the stack is returned unculled from that span down: the lines
+// that do not reach child only fail the box test.
+static const LineSpan* cullSpans(const LineSpan* spans, quad_tree* child,
+                                 size_t* num_made) {
+  if (spans == NULL) {
+    *num_made = 0;
+    return NULL;
+  }
+  const LineSpan* next = cullSpans(spans->next, child, num_made);
+
+  size_t num_reaching = 0;
+  for (size_t i = 0; i < spans->num_lines; i++) {
+    num_reaching += reachesNode(spans->lines[i], child);
+  }
+  if (num_reaching == 0) {
+    return next;
+  }
+  if (num_reaching == spans->num_lines && next == spans->next) {
+    return spans;
+  }
+
+  // The lines follow the span in the same allocation, unless all of them are
+  // kept and the array can be shared.
+  bool copy = num_reaching < spans->num_lines;
+  LineSpan* span = malloc(sizeof(LineSpan)
+                          + (copy ? num_reaching * sizeof(Line*) : 0));
+  if (span == NULL) {
+    freeSpans(next, *num_made);
+    *num_made = 0;
+    return spans;
+  }
+  span->lines = spans->lines;
+  if (copy) {
+    span->lines = (Line**) (span + 1);
+    size_t j = 0;
+    for (size_t i = 0; i < spans->num_lines; i++) {
+      if (reachesNode(spans->lines[i], child)) {
+        span->lines[j++] = spans->lines[i];
+      }
+    }
+  }
+  span->num_lines = num_reaching;
+  span->next = next;
+  (*num_made)++;
+  return span;
+}
+
+static inline bool isLeaf(quad_tree* tree) {
+  return tree->quad1 == NULL && tree->quad2 == NULL && tree->quad3 == NULL
+      && tree->quad4 == NULL;
+}
+
+// Appends the intersections within the given quad_tree, whose ancestors
+// store the upstream lines that reach it, one node at a time.
+static void getSubtreeEvents(quad_tree* tree, double timeStep,
+                             const LineSpan* upstream,
+                             IntersectionEventList* intersectionEventList,
+                             PairTestCounters* tally) {
+  if (tree == NULL) return;
+
+  for (size_t i = 0; i < tree->num_own_lines; i++) {
+    testRow(tree->lines, tree->num_own_lines, i, upstream, timeStep,
+            intersectionEventList, tally);
+  }
+  if (isLeaf(tree)) return;
+
+  // The children see this node's lines on top of its upstream lines.
+  LineSpan own = { tree->lines, tree->num_own_lines, upstream };
+  quad_tree* children[4] = { tree->quad1, tree->quad2, tree->quad3,
+                             tree->quad4 };
+  for (int c = 0; c < 4; c++) {
+    if (children[c] == NULL) continue;
+    size_t num_made;
+    const LineSpan* culled = cullSpans(&own, children[c], &num_made);
+    getSubtreeEvents(children[c], timeStep, culled, intersectionEventList,
+                     tally);
+    freeSpans(culled, num_made);
+  }
+}
+
+// Estimates the pair tests in the given quad_tree, whose ancestors store
+// num_upstream lines that reach it: each node tests its own lines against
+// each other and against the upstream lines.  Since the estimate does not
+// cull, it is an upper bound below the root.
+static unsigned long long subtreeWork(quad_tree* tree,
+                                      unsigned long long num_upstream) {
+  if (tree == NULL) return 0;
+  unsigned long long own = tree->num_own_lines;
+  unsigned long long work = (own > 0) ? own * (own - 1) / 2 : 0;
+  work += own * num_upstream;
+  return work + subtreeWork(tree->quad1, num_upstream + own)
+              + subtreeWork(tree->quad2, num_upstream + own)
+              + subtreeWork(tree->quad3, num_upstream + own)
+              + subtreeWork(tree->quad4, num_upstream + own);
+}
+
+// Turns the light subtrees planned since the last call into one task.
+static void closeBatch(TraversalPlan* plan) {
+  if (plan->num_subtrees > plan->batch_begin) {
+    TraversalTask* task = &plan->tasks[plan->num_tasks++];
+    task->num_rows = 0;
+    task->first_subtree = plan->batch_begin;
+    task->last_subtree = plan->num_subtrees;
+    plan->batch_begin = plan->num_subtrees;
+  }
+  plan->batch_work = 0;
+}
+
+// Plans the traversal of the given quad_tree in depth-first order.  A subtree
+// with no more than the target work is handled whole, together with the
+// light subtrees next to it.  A heavier node has its own rows split into
+// tasks of about the target work, and its children are planned in turn.
+static void planSubtree(TraversalPlan* plan, quad_tree* tree,
+                        const LineSpan* upstream) {
+  if (tree == NULL) return;
+
+  unsigned long long num_upstream = countSpans(upstream);
+  unsigned long long work = subtreeWork(tree, num_upstream);
+  if (work <= plan->target_work) {
+    TraversalSubtree* subtree = &plan->subtrees[plan->num_subtrees++];
+    subtree->tree = tree;
+    subtree->upstream = upstream;
+    plan->batch_work += work;
+    if (plan->batch_work >= plan->target_work) {
+      closeBatch(plan);
+    }
+    return;
+  }
+
+  size_t own = tree->num_own_lines;
+  size_t i = 0;
+  while (i < own) {
+    TraversalTask* task = &plan->tasks[plan->num_tasks++];
+    task->own = tree->lines;
+    task->num_own = own;
+    task->first_row = i;
+    task->num_rows = 0;
+    task->upstream = upstream;
+    task->first_subtree = task->last_subtree = 0;
+    unsigned long long row_work = 0;
+    do {
+      // Row i is tested against the own lines after it and the upstream
+      // lines.
+      row_work += (own - 1 - i) + num_upstream;
+      task->num_rows++;
+      i++;
+    } while (i < own && row_work < plan->target_work);
+  }
+  if (isLeaf(tree)) return;
+
+  LineSpan* own_span = &plan->own_spans[plan->num_own_spans++];
+  own_span->lines = tree->lines;
+  own_span->num_lines = own;
+  own_span->next = upstream;
+  quad_tree* children[4] = { tree->quad1, tree->quad2, tree->quad3,
+                             tree->quad4 };
+  for (int c = 0; c < 4; c++) {
+    if (children[c] == NULL) continue;
+    MadeSpans* made = &plan->made[plan->num_made++];
+    made->spans = cullSpans(own_span, children[c], &made->num_made);
+    planSubtree(plan, children[c], made->spans);
+  }
+}
+
+static void runTraversalTasks(size_t begin, size_t end, void* arg) {
+  PERF_ATTACH_THREAD();
+  TraversalPlan* plan = arg;
+  for (size_t t = begin; t < end; t++) {
+    TRACE_BEGIN(trace_mark);
+    TraversalTask* task = &plan->tasks[t];
+    task->result = IntersectionEventList_make();
+
+    // Pair tests are counted locally and added to this worker's counters once
+    // the task is done.
+    PairTestCounters tally = { 0, 0 };
+    PairTestCounters* own_tally = (plan->counters != NULL) ? &tally : NULL;
+
+    size_t num_lines = task->num_rows;
+    for (size_t i = 0; i < task->num_rows; i++) {
+      testRow(task->own, task->num_own, task->first_row + i, task->upstream,
+              plan->timeStep, &task->result, own_tally);
+    }
+    for (size_t s = task->first_subtree; s < task->last_subtree; s++) {
+      TraversalSubtree* subtree = &plan->subtrees[s];
+      getSubtreeEvents(subtree->tree, plan->timeStep, subtree->upstream,
+                       &task->result, own_tally);
+      num_lines += subtree->tree->num_lines;
+    }
+
+    if (plan->counters != NULL) {
+      PairTestCounters* own = &plan->counters[Parallel_getWorkerNumber()];
+      own->numIntersectCalls += tally.numIntersectCalls;
+      own->numBoxRejections += tally.numBoxRejections;
+    }
+    TRACE_END(trace_mark, TRACE_TRAVERSE_TASK, num_lines);
+  }
+}
+
 // Method that computes the list of intersections within the given quad_tree
 IntersectionEventList CollisionWorld_getIntersectionEvents(quad_tree* tree,
-  double timeStep, line_node* upstream_lines) {
+  double timeStep, const LineSpan* upstream, PairTestCounters* counters) {
+  PERF_ATTACH_THREAD();
   IntersectionEventList intersectionEventList = IntersectionEventList_make();
   if (tree == NULL) return intersectionEventList;
 
-  line_node* first_node;
-  line_node* second_node;
-  first_node = tree->lines;
+  // Every task is either a run of whole subtrees or a chunk of one node's
+  // rows, so there are at most as many of them as nodes plus lines.
+  size_t num_nodes = 0;
+  unsigned int max_depth = 0;
+  quad_tree_shape(tree, 0, &num_nodes, &max_depth);
+  TraversalPlan plan;
+  plan.timeStep = timeStep;
+  plan.counters = counters;
+  plan.subtrees = malloc(num_nodes * sizeof(TraversalSubtree));
+  plan.tasks = malloc((num_nodes + tree->num_lines) * sizeof(TraversalTask));
+  plan.own_spans = malloc(num_nodes * sizeof(LineSpan));
+  plan.made = malloc(num_nodes * sizeof(MadeSpans));
+  plan.num_subtrees = 0;
+  plan.num_tasks = 0;
+  plan.batch_begin = 0;
+  plan.batch_work = 0;
+  plan.num_own_spans = 0;
+  plan.num_made = 0;
+
+  plan.target_work = subtreeWork(tree, countSpans(upstream))
+      / (Parallel_getNumWorkers() * TRAVERSE_TASKS_PER_WORKER);
+  if (plan.target_work < TRAVERSE_MIN_TASK_WORK) {
+    plan.target_work = TRAVERSE_MIN_TASK_WORK;
+  }
+  planSubtree(&plan, tree, upstream);
+  closeBatch(&plan);
+
+  Parallel_for(plan.num_tasks, 1, runTraversalTasks, &plan);
 
-  // First iterate through all pairs of line segments that cannot be
-  // completely inserted into sub-quad_trees
-  while (first_node != NULL) {
-    second_node = first_node->next;
-    while (second_node != NULL) {
-      Line* l1 = first_node->line;
-      Line* l2 = second_node->line;
+  // Merge the intersections obtained by the tasks so that we now have one
+  // unified list.
+  for (size_t t = 0; t < plan.num_tasks; t++) {
+    IntersectionEventList_mergeLists(&intersectionEventList,
+                                     &plan.tasks[t].result);
+  }
+  for (size_t i = 0; i < plan.num_made; i++) {
+    freeSpans(plan.made[i].spans, plan.made[i].num_made);
+  }
+  free(plan.made);
+  free(plan.own_spans);
+  free(plan.subtrees);
+  free(plan.tasks);
+
+  return intersectionEventList;
+}
+
+// Arguments of runPairTasks.  Task t tests pairs
+// [t * PAIR_TASK_SIZE, (t + 1) * PAIR_TASK_SIZE) of the list.
+struct PairTasks {
+  PairList* pairList;
+  double timeStep;
+  PairTestCounters* counters;
+  IntersectionEventList* results;
+};
+typedef struct PairTasks PairTasks;
+
+static void runPairTasks(size_t begin, size_t end, void* arg) {
+  PERF_ATTACH_THREAD();
+  PairTasks* tasks = arg;
+  for (size_t t = begin; t < end; t++) {
+    TRACE_BEGIN(trace_mark);
+    IntersectionEventList* result = &tasks->results[t];
+    *result = IntersectionEventList_make();
+
+    PairTestCounters tally = { 0, 0 };
+    PairTestCounters* own_tally = (tasks->counters != NULL) ? &tally : NULL;
+    size_t first = t * PAIR_TASK_SIZE;
+    size_t last = first + PAIR_TASK_SIZE;
+    if (last > tasks->pairList->numPairs) {
+      last = tasks->pairList->numPairs;
+    }
+    for (size_t i = first; i < last; i++) {
+      LinePair* pair = &tasks->pairList->pairs[i];
+      testPair(pair->l1, pair->l2, tasks->timeStep, result, own_tally);
+    }
+
+    if (tasks->counters != NULL) {
+      PairTestCounters* own = &tasks->counters[Parallel_getWorkerNumber()];
+      own->numIntersectCalls += tally.numIntersectCalls;
+      own->numBoxRejections += tally.numBoxRejections;
+    }
+    TRACE_END(trace_mark, TRACE_TRAVERSE_TASK, last - first);
+  }
+}
+
+IntersectionEventList CollisionWorld_getIntersectionEventsFromPairs(
+    PairList* pairList, double timeStep, PairTestCounters* counters) {
+  PERF_ATTACH_THREAD();
+  IntersectionEventList intersectionEventList = IntersectionEventList_make();
+  size_t numTasks = (pairList->numPairs + PAIR_TASK_SIZE - 1) / PAIR_TASK_SIZE;
+  PairTasks tasks;
+  tasks.pairList = pairList;
+  tasks.timeStep = timeStep;
+  tasks.counters = counters;
+  tasks.results = malloc(numTasks * sizeof(IntersectionEventList));
+  Parallel_for(numTasks, 1, runPairTasks, &tasks);
+  for (size_t t = 0; t < numTasks; t++) {
+    IntersectionEventList_mergeLists(&intersectionEventList,
+                                     &tasks.results[t]);
+  }
+  free(tasks.results);
+  return intersectionEventList;
+}
+
+IntersectionEventList CollisionWorld_getIntersectionEventsBruteForce(
+    CollisionWorld* collisionWorld) {
+  IntersectionEventList intersectionEventList = IntersectionEventList_make();
+  double timeStep = collisionWorld->timeStep;
+
+  for (size_t i = 0; i < collisionWorld->numOfLines; i++) {
+    update_box(collisionWorld->lines[i], timeStep);
+  }
+  for (size_t i = 0; i < collisionWorld->numOfLines; i++) {
+    for (size_t j = i + 1; j < collisionWorld->numOfLines; j++) {
+      Line* l1 = collisionWorld->lines[i];
+      Line* l2 = collisionWorld->lines[j];
 
       // intersect expects compareLines(l1, l2) < 0 to be true.
       // Swap l1 and l2, if necessary.
@@ -225,135 +1257,1070 @@ IntersectionEventList CollisionWorld_getIntersectionEvents(quad_tree* tree,
         IntersectionEventList_appendNode(&intersectionEventList, l1, l2,
                                          intersectionType);
       }
-      second_node = second_node->next;
     }
-    first_node = first_node->next;
   }
+  return intersectionEventList;
+}
 
-  // Now iterate through all pairs of line segments (a,b) where a is a line
-  // segment that cannot be completely inserted into any one sub-quad_tree,
-  // and b is a line segment of a quad_tree that contains the current quad_tree
-  // as a sub-quad_tree
-  first_node = tree->lines;
-  while (first_node != NULL) {
-    second_node = upstream_lines;
-    while (second_node != NULL) {
-      Line* l1 = first_node->line;
-      Line* l2 = second_node->line;
+static int compareEventNodes(const void* a, const void* b) {
+  return IntersectionEventNode_compareData(*(IntersectionEventNode**) a,
+                                           *(IntersectionEventNode**) b);
+}
 
-      // intersect expects compareLines(l1, l2) < 0 to be true.
-      // Swap l1 and l2, if necessary.
-      if (compareLines(l1, l2) >= 0) {
-        Line *temp = l1;
-        l1 = l2;
-        l2 = temp;
-      }
+// Compares the sorted events found by the broadphase against the brute-force
+// reference, and reports the first missing or extra event.  Returns true if
+// both sets are equal; a frame that cannot be checked for lack of memory is
+// reported and counts as a mismatch.
+static bool verifyEvents(CollisionWorld* collisionWorld,
+                         IntersectionEventList* events) {
+  IntersectionEventList reference =
+      CollisionWorld_getIntersectionEventsBruteForce(collisionWorld);
+  size_t numReference = reference.numIntersections;
+  IntersectionEventNode** sorted =
+      malloc((numReference + 1) * sizeof(IntersectionEventNode*));
+  if (sorted == NULL) {
+    fprintf(stderr, "Frame %" PRIu64 ": could not verify the broadphase, "
+            "out of memory\n", collisionWorld->frameCount);
+    IntersectionEventList_deleteNodes(&reference);
+    return false;
+  }
+  size_t i = 0;
+  for (IntersectionEventNode* node = reference.head; node != NULL;
+       node = node->next) {
+    sorted[i++] = node;
+  }
+  qsort(sorted, numReference, sizeof(IntersectionEventNode*),
+        compareEventNodes);
 
-      IntersectionType intersectionType = intersect(l1, l2, timeStep);
-      if (intersectionType != NO_INTERSECTION) {
-        IntersectionEventList_appendNode(&intersectionEventList, l1, l2,
-                                         intersectionType);
+  // Walk both sorted sets in step until they first differ.
+  IntersectionEventNode* node = events->head;
+  i = 0;
+  while (node != NULL && i < numReference
+         && IntersectionEventNode_compareData(node, sorted[i]) == 0
+         && node->intersectionType == sorted[i]->intersectionType) {
+    node = node->next;
+    i++;
+  }
+
+  bool equal = (node == NULL && i == numReference);
+  if (!equal) {
+    const char* kind;
+    IntersectionEventNode* culprit;
+    if (node == NULL) {
+      kind = "missing";
+      culprit = sorted[i];
+    } else if (i == numReference) {
+      kind = "extra";
+      culprit = node;
+    } else if (IntersectionEventNode_compareData(node, sorted[i]) > 0) {
+      kind = "missing";
+      culprit = sorted[i];
+    } else if (IntersectionEventNode_compareData(node, sorted[i]) < 0) {
+      kind = "extra";
+      culprit = node;
+    } else {
+      kind = "mistyped";
+      culprit = node;
+    }
+    fprintf(stderr, "Frame %" PRIu64 ": broadphase %s event (%" PRIu64 ", %"
+            PRIu64 ", %d); %zu events, %zu expected\n",
+            collisionWorld->frameCount, kind, culprit->l1->id,
+            culprit->l2->id, culprit->intersectionType,
+            events->numIntersections, numReference);
+  }
+
+  free(sorted);
+  IntersectionEventList_deleteNodes(&reference);
+  return equal;
+}
+
+// Walks the tree and records its shape and the size of the culled upstream
+// set at every node.
+static void collectTreeStats(quad_tree* tree, unsigned int depth,
+                             const LineSpan* upstream,
+                             CollisionWorldFrameStats* stats) {
+  if (tree == NULL) return;
+  size_t num_upstream = countSpans(upstream);
+  unsigned int level = (depth < STATS_MAX_LEVELS) ? depth : STATS_MAX_LEVELS - 1;
+  size_t num_own = tree->num_own_lines;
+
+  stats->numNodes[level]++;
+  stats->totalUpstream[level] += num_upstream;
+  if (num_upstream > stats->maxUpstream[level])
+    stats->maxUpstream[level] = num_upstream;
+
+  if (tree->quad1 == NULL && tree->quad2 == NULL && tree->quad3 == NULL
+      && tree->quad4 == NULL) {
+    double occupancy = (double) num_own / N;
+    stats->numLeaves++;
+    stats->meanLeafDepth += depth;
+    stats->meanLeafOccupancy += occupancy;
+    if (occupancy > stats->maxLeafOccupancy)
+      stats->maxLeafOccupancy = occupancy;
+    return;
+  }
+
+  // Lines stored at an inner node are the ones that straddle its children.
+  stats->numStraddlers[level] += num_own;
+  quad_tree* children[4] = { tree->quad1, tree->quad2, tree->quad3,
+                             tree->quad4 };
+  LineSpan own = { tree->lines, tree->num_own_lines, upstream };
+  for (int c = 0; c < 4; c++) {
+    if (children[c] == NULL) continue;
+    size_t num_made;
+    const LineSpan* culled = cullSpans(&own, children[c], &num_made);
+    collectTreeStats(children[c], depth + 1, culled, stats);
+    freeSpans(culled, num_made);
+  }
+}
+
+// Arguments of runStaticQueryTasks.  Task t queries the static index with
+// dynamic lines [t * STATIC_QUERY_TASK_SIZE, (t + 1) * STATIC_QUERY_TASK_SIZE).
+struct StaticQueryTasks {
+  CollisionWorld* collisionWorld;
+  IntersectionEventList* results;
+};
+typedef struct StaticQueryTasks StaticQueryTasks;
+
+// The dynamic line a query is for, and where its pair tests go.
+struct StaticQuery {
+  Line* line;
+  double timeStep;
+  IntersectionEventList* result;
+  PairTestCounters* tally;
+};
+typedef struct StaticQuery StaticQuery;
+
+static void testStaticLine(Line* staticLine, void* arg) {
+  StaticQuery* query = arg;
+  testPair(query->line, staticLine, query->timeStep, query->result,
+           query->tally);
+}
+
+static void runStaticQueryTasks(size_t begin, size_t end, void* arg) {
+  PERF_ATTACH_THREAD();
+  StaticQueryTasks* tasks = arg;
+  CollisionWorld* collisionWorld = tasks->collisionWorld;
+  StaticIndex* index = collisionWorld->staticIndex;
+  PairTestCounters* counters = collisionWorld->pairTestCounters;
+  for (size_t t = begin; t < end; t++) {
+    TRACE_BEGIN(trace_mark);
+    PairTestCounters tally = { 0, 0 };
+    StaticQuery query;
+    query.timeStep = collisionWorld->timeStep;
+    query.result = &tasks->results[t];
+    query.tally = (counters != NULL) ? &tally : NULL;
+    *query.result = IntersectionEventList_make();
+
+    size_t first = t * STATIC_QUERY_TASK_SIZE;
+    size_t last = first + STATIC_QUERY_TASK_SIZE;
+    if (last > index->numDynamic) {
+      last = index->numDynamic;
+    }
+    for (size_t d = first; d < last; d++) {
+      query.line = collisionWorld->lines[index->dynamicLines[d]];
+      StaticIndex_query(index, query.line, testStaticLine, &query);
+    }
+
+    if (counters != NULL) {
+      PairTestCounters* own = &counters[Parallel_getWorkerNumber()];
+      own->numIntersectCalls += tally.numIntersectCalls;
+      own->numBoxRejections += tally.numBoxRejections;
+    }
+    TRACE_END(trace_mark, TRACE_TRAVERSE_TASK, last - first);
+  }
+}
+
+// Appends the intersections that involve static lines: those of the dynamic
+// lines, whose boxes must be up to date, with the static lines, and the
+// cached ones among the static lines.
+static void appendStaticEvents(CollisionWorld* collisionWorld,
+                               IntersectionEventList* intersectionEventList) {
+  StaticIndex* index = collisionWorld->staticIndex;
+  if (index->numStatic == 0) {
+    return;
+  }
+  size_t numTasks = (index->numDynamic + STATIC_QUERY_TASK_SIZE - 1)
+      / STATIC_QUERY_TASK_SIZE;
+  StaticQueryTasks tasks;
+  tasks.collisionWorld = collisionWorld;
+  tasks.results = malloc(numTasks * sizeof(IntersectionEventList));
+  Parallel_for(numTasks, 1, runStaticQueryTasks, &tasks);
+  for (size_t t = 0; t < numTasks; t++) {
+    IntersectionEventList_mergeLists(intersectionEventList,
+                                     &tasks.results[t]);
+  }
+  free(tasks.results);
+  StaticIndex_appendStaticEvents(index, collisionWorld->timeStep,
+                                 intersectionEventList);
+}
+
+// Finds the frame's intersections through a quadtree built for the frame.
+// With the static partition, the quadtree only holds the dynamic lines.
+static IntersectionEventList getQuadtreeEvents(CollisionWorld* collisionWorld) {
+  CollisionWorldFrameStats* stats = &collisionWorld->frameStats;
+  PairTestCounters* counters = collisionWorld->pairTestCounters;
+  StaticIndex* index = collisionWorld->staticIndex;
+
+  PHASE_BEGIN(PHASE_BUILD);
+  quad_tree* tree;
+  // Without the memory to rebuild the index, the quadtree holds every line.
+  bool partitioned = collisionWorld->staticPartition;
+  if (partitioned && !StaticIndex_isValid(index, collisionWorld->numOfLines)) {
+    partitioned = StaticIndex_build(index, collisionWorld->lines,
+                                    collisionWorld->numOfLines,
+                                    collisionWorld->timeStep);
+    if (partitioned) {
+      for (size_t d = 0; d < index->numDynamic; d++) {
+        collisionWorld->dynamicNodes[d] =
+            collisionWorld->line_nodes[index->dynamicLines[d]];
       }
-      second_node = second_node->next;
-    }
-    first_node = first_node->next;
-  }
-
-  IntersectionEventList intersectionEventListQuad1;
-  IntersectionEventList intersectionEventListQuad2;
-  IntersectionEventList intersectionEventListQuad3;
-  IntersectionEventList intersectionEventListQuad4;
-
-  // We can now propagate tree->lines to all lower sub-quad_trees
-  // This does not lead to data races since no element of upstream_lines
-  // is modified by the functions that use tree->lines, and tree->lines
-  // is a variable that is only being read by multiple threads
-  merge_lists(&tree->lines, upstream_lines);
-
-  // For large quad_trees we perform the operation of computing intersections in parallel
-  if (tree->num_lines > INTERSECT_COARSE_LIM) {
-    intersectionEventListQuad1 = \
-      cilk_spawn CollisionWorld_getIntersectionEvents(tree->quad1, timeStep, tree->lines);
-    intersectionEventListQuad2 = \
-      cilk_spawn CollisionWorld_getIntersectionEvents(tree->quad2, timeStep, tree->lines);
-    intersectionEventListQuad3 = \
-      cilk_spawn CollisionWorld_getIntersectionEvents(tree->quad3, timeStep, tree->lines);
-    intersectionEventListQuad4 = \
-      CollisionWorld_getIntersectionEvents(tree->quad4, timeStep, tree->lines);
-    cilk_sync;
+    }
+  }
+  if (partitioned) {
+    StaticIndex_refresh(index, collisionWorld->timeStep);
+    tree = buildQuadtreeOver(collisionWorld, collisionWorld->dynamicNodes,
+                             index->numDynamic);
+    stats->numStaticLines = index->numStatic;
+    stats->numStaticIndexBuilds = index->numBuilds;
   } else {
-    // For very small quad_trees we do not pay the overhead of spawning
-    // new threads
-    intersectionEventListQuad1 = \
-      CollisionWorld_getIntersectionEvents(tree->quad1, timeStep, tree->lines);
-    intersectionEventListQuad2 = \
-      CollisionWorld_getIntersectionEvents(tree->quad2, timeStep, tree->lines);
-    intersectionEventListQuad3 = \
-      CollisionWorld_getIntersectionEvents(tree->quad3, timeStep, tree->lines);
-    intersectionEventListQuad4 = \
-      CollisionWorld_getIntersectionEvents(tree->quad4, timeStep, tree->lines);
-  }
-
-  // Merge the intersections obtained in sub-quad_trees so that we
-  // now have one unified list.
-  IntersectionEventList_mergeLists(&intersectionEventList,
-    &intersectionEventListQuad1);
-  IntersectionEventList_mergeLists(&intersectionEventList,
-    &intersectionEventListQuad2);
-  IntersectionEventList_mergeLists(&intersectionEventList,
-    &intersectionEventListQuad3);
-  IntersectionEventList_mergeLists(&intersectionEventList,
-    &intersectionEventListQuad4);
+    tree = build_quadtree(collisionWorld);
+  }
+  PHASE_END(PHASE_BUILD);
 
-  return intersectionEventList;
-}
+  if (counters != NULL) {
+    collectTreeStats(tree, 0, NULL, stats);
+    if (stats->numLeaves > 0) {
+      stats->meanLeafDepth /= stats->numLeaves;
+      stats->meanLeafOccupancy /= stats->numLeaves;
+    }
+  }
 
-void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld) {
-  quad_tree* tree = build_quadtree(collisionWorld);
   // Use the constructed quad_tree to detect line-line collisions
   // All line-line intersections are recorded in intersectionEventList
+  PHASE_BEGIN(PHASE_TRAVERSE);
   IntersectionEventList intersectionEventList = \
-    CollisionWorld_getIntersectionEvents(tree, collisionWorld->timeStep, NULL);
-  collisionWorld->numLineLineCollisions += intersectionEventList.numIntersections;
+    CollisionWorld_getIntersectionEvents(tree, collisionWorld->timeStep, NULL,
+                                         counters);
+  if (partitioned) {
+    appendStaticEvents(collisionWorld, &intersectionEventList);
+  }
+  PHASE_END(PHASE_TRAVERSE);
+  quad_tree_shape(tree, 0, &stats->numTreeNodes, &stats->maxTreeDepth);
+  PHASE_BEGIN(PHASE_BUILD);
   quad_tree_delete(tree);
-  // Sort the intersection event list.
-  IntersectionEventNode* startNode = intersectionEventList.head;
-  while (startNode != NULL) {
-    IntersectionEventNode* minNode = startNode;
-    IntersectionEventNode* curNode = startNode->next;
-    while (curNode != NULL) {
-      if (IntersectionEventNode_compareData(curNode, minNode) < 0) {
-        minNode = curNode;
-      }
-      curNode = curNode->next;
+  PHASE_END(PHASE_BUILD);
+  return intersectionEventList;
+}
+
+// Arguments of refreshBoxesBlock.
+struct RefreshBoxesArgs {
+  CollisionWorld* collisionWorld;
+  // Whether to check the boxes against the PairList, and whether a line was
+  // found outside its grown box.
+  bool check;
+  bool stale;
+};
+typedef struct RefreshBoxesArgs RefreshBoxesArgs;
+
+static void refreshBoxesBlock(size_t begin, size_t end, void* arg) {
+  RefreshBoxesArgs* args = arg;
+  CollisionWorld* collisionWorld = args->collisionWorld;
+  bool stale = false;
+  if (end > collisionWorld->numOfLines) {
+    end = collisionWorld->numOfLines;
+  }
+  for (size_t i = begin; i < end; i++) {
+    Line* line = collisionWorld->lines[i];
+    update_box(line, collisionWorld->timeStep);
+    if (args->check && i < collisionWorld->pairList->numLines) {
+      stale |= !PairList_holds(collisionWorld->pairList, i, line);
     }
-    if (minNode != startNode) {
-      IntersectionEventNode_swapData(minNode, startNode);
+  }
+  if (stale) {
+    __atomic_store_n(&args->stale, true, __ATOMIC_RELAXED);
+  }
+}
+
+// Finds the frame's intersections among the PairList's candidate pairs.  The
+// list is rebuilt first if it has expired or a line has left its grown box,
+// and otherwise extended with the lines added since the last frame.  Falls
+// back to the quadtree if the list runs out of memory.
+static IntersectionEventList getPairListEvents(CollisionWorld* collisionWorld) {
+  CollisionWorldFrameStats* stats = &collisionWorld->frameStats;
+  PairList* pairList = collisionWorld->pairList;
+
+  PHASE_BEGIN(PHASE_BUILD);
+  RefreshBoxesArgs args;
+  args.collisionWorld = collisionWorld;
+  args.check = !PairList_isExpired(pairList, collisionWorld->numOfLines);
+  args.stale = false;
+  Parallel_forStatic(collisionWorld->capacity, refreshBoxesBlock, &args);
+  stats->pairListRebuilt = !args.check || args.stale;
+  bool built = true;
+  if (stats->pairListRebuilt) {
+    built = PairList_build(pairList, collisionWorld->lines,
+                           collisionWorld->numOfLines,
+                           collisionWorld->timeStep, PAIR_LIST_SKIN_FRAMES);
+  } else if (pairList->numLines < collisionWorld->numOfLines) {
+    built = PairList_extend(pairList, collisionWorld->lines,
+                            collisionWorld->numOfLines);
+  }
+  PHASE_END(PHASE_BUILD);
+  if (!built) {
+    // Out of memory for the pairs: the quadtree finds the frame's events
+    // instead, and the list is rebuilt on a later frame.
+    return getQuadtreeEvents(collisionWorld);
+  }
+
+  PHASE_BEGIN(PHASE_TRAVERSE);
+  IntersectionEventList intersectionEventList =
+      CollisionWorld_getIntersectionEventsFromPairs(
+          pairList, collisionWorld->timeStep,
+          collisionWorld->pairTestCounters);
+  PHASE_END(PHASE_TRAVERSE);
+  pairList->age++;
+  stats->numCandidatePairs = pairList->numPairs;
+  stats->numPairListBuilds = pairList->numBuilds;
+  return intersectionEventList;
+}
+
+// Returns the index of the line in the world's storage.
+static inline size_t lineIndex(CollisionWorld* collisionWorld,
+                               Line* line) {
+  size_t index = line - collisionWorld->lineStorage;
+  assert(collisionWorld->lines[index] == line);
+  return index;
+}
+
+// Wakes the line if it is static in the static index but can no longer stay
+// static.
+static inline void wakeIfMoved(CollisionWorld* collisionWorld, Line* line) {
+  StaticIndex* index = collisionWorld->staticIndex;
+  size_t i = lineIndex(collisionWorld, line);
+  if (index->isStatic[i] && !StaticIndex_canStay(index, i)) {
+    StaticIndex_wake(index, i);
+    collisionWorld->dynamicNodes[index->numDynamic - 1] =
+        collisionWorld->line_nodes[i];
+  }
+}
+
+// Appends the frame's solved events to the ones buffered for the callback.
+// If the buffer cannot grow, the events are handed over early in batches
+// that fit, which keeps them in order.
+static void recordEvents(CollisionWorld* collisionWorld,
+                         IntersectionEventList* intersectionEventList) {
+  size_t needed = collisionWorld->numEvents
+      + intersectionEventList->numIntersections;
+  if (needed > collisionWorld->eventCapacity) {
+    size_t capacity = 2 * collisionWorld->eventCapacity;
+    if (capacity < needed) {
+      capacity = needed;
+    }
+    CollisionEvent* events = realloc(collisionWorld->events,
+                                     capacity * sizeof(CollisionEvent));
+    if (events != NULL) {
+      collisionWorld->events = events;
+      collisionWorld->eventCapacity = capacity;
+    }
+  }
+  for (IntersectionEventNode* node = intersectionEventList->head;
+       node != NULL; node = node->next) {
+    CollisionEvent event;
+    event.frame = collisionWorld->frameCount;
+    event.id1 = node->l1->id;
+    event.id2 = node->l2->id;
+    event.intersectionType = node->intersectionType;
+    if (collisionWorld->eventCapacity == 0) {
+      collisionWorld->eventCallback(&event, 1,
+                                    collisionWorld->eventCallbackArg);
+      continue;
+    }
+    if (collisionWorld->numEvents == collisionWorld->eventCapacity) {
+      deliverEvents(collisionWorld);
     }
-    startNode = startNode->next;
+    collisionWorld->events[collisionWorld->numEvents++] = event;
+  }
+}
+
+// Sorts the frame's intersection events, checks them against brute force if
+// requested, solves them in order, records them for the event callback and
+// wakes the static lines they moved.
+static void resolveEvents(CollisionWorld* collisionWorld,
+                          IntersectionEventList* intersectionEventList) {
+  // Sort the intersection event list.
+  PHASE_BEGIN(PHASE_SORT);
+  IntersectionEventList_sort(intersectionEventList);
+  PHASE_END(PHASE_SORT);
+
+  if (collisionWorld->verifyBroadphase
+      && !verifyEvents(collisionWorld, intersectionEventList)) {
+    collisionWorld->numBroadphaseMismatches++;
   }
 
   // Call the collision solver for each intersection event.
-  IntersectionEventNode* curNode = intersectionEventList.head;
+  PHASE_BEGIN(PHASE_SOLVE);
+  IntersectionEventNode* curNode = intersectionEventList->head;
 
   while (curNode != NULL) {
     CollisionWorld_collisionSolver(collisionWorld, curNode->l1, curNode->l2,
                                    curNode->intersectionType);
     curNode = curNode->next;
   }
+
+  if (collisionWorld->eventCallback != NULL) {
+    recordEvents(collisionWorld, intersectionEventList);
+  }
+  if (collisionWorld->eventLog != NULL
+      && !EventLog_writeFrame(collisionWorld->eventLog,
+                              intersectionEventList)) {
+    fprintf(stderr, "Frame %" PRIu64 ": could not write the event log, "
+            "stopped logging\n", collisionWorld->frameCount);
+    collisionWorld->eventLog = NULL;
+  }
+
+  // A static line that was given a velocity wakes up and joins the dynamic
+  // lines from the next frame on.
+  StaticIndex* index = collisionWorld->staticIndex;
+  if (StaticIndex_isValid(index, collisionWorld->numOfLines)) {
+    for (curNode = intersectionEventList->head; curNode != NULL;
+         curNode = curNode->next) {
+      wakeIfMoved(collisionWorld, curNode->l1);
+      wakeIfMoved(collisionWorld, curNode->l2);
+    }
+  }
+  PHASE_END(PHASE_SOLVE);
+}
+
+
+// Solves the events logged for the frame in place of detecting them.
+// Returns false, and stops the replay, once the log has run out.
+static bool replayEvents(CollisionWorld* collisionWorld) {
+  EventLog* log = collisionWorld->replayLog;
+  CollisionWorldFrameStats* stats = &collisionWorld->frameStats;
+  memset(stats, 0, sizeof(CollisionWorldFrameStats));
+  PHASE_BEGIN(PHASE_SOLVE);
+  if (!EventLog_readFrame(log)) {
+    PHASE_END(PHASE_SOLVE);
+    collisionWorld->replayLog = NULL;
+    return false;
+  }
+
+  // A frame naming lines that are not in the world ends the replay before
+  // any of its events is solved.
+  Line** lines = collisionWorld->lines;
+  LineTable* table = collisionWorld->lineTable;
+  for (size_t i = 0; i < log->numEvents; i++) {
+    const LoggedEvent* event = &log->events[i];
+    if (LineTable_find(table, event->id1) == LINE_TABLE_NONE
+        || LineTable_find(table, event->id2) == LINE_TABLE_NONE) {
+      PHASE_END(PHASE_SOLVE);
+      collisionWorld->replayLog = NULL;
+      return false;
+    }
+  }
+
+  bool wake = StaticIndex_isValid(collisionWorld->staticIndex,
+                                  collisionWorld->numOfLines);
+  for (size_t i = 0; i < log->numEvents; i++) {
+    const LoggedEvent* event = &log->events[i];
+    Line* l1 = lines[LineTable_find(table, event->id1)];
+    Line* l2 = lines[LineTable_find(table, event->id2)];
+    CollisionWorld_collisionSolver(collisionWorld, l1, l2,
+                                   event->intersectionType);
+    if (wake) {
+      wakeIfMoved(collisionWorld, l1);
+      wakeIfMoved(collisionWorld, l2);
+    }
+  }
+  PHASE_END(PHASE_SOLVE);
+  collisionWorld->numLineLineCollisions += log->numEvents;
+  stats->numEvents = log->numEvents;
+
+  // The KineticEngine's predictions do not know of the replayed events.
+  collisionWorld->kineticEngine->built = false;
+  return true;
+}
+
+void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld) {
+  CollisionWorldFrameStats* stats = &collisionWorld->frameStats;
+  PairTestCounters* counters = collisionWorld->pairTestCounters;
+
+  memset(stats, 0, sizeof(CollisionWorldFrameStats));
+  if (counters != NULL) {
+    memset(counters, 0,
+           collisionWorld->numPairTestCounters * sizeof(PairTestCounters));
+  }
+
+  catchUpLines(collisionWorld);
+  IntersectionEventList intersectionEventList =
+      (collisionWorld->broadphase == BROADPHASE_PAIR_LIST)
+      ? getPairListEvents(collisionWorld)
+      : getQuadtreeEvents(collisionWorld);
+  collisionWorld->numLineLineCollisions += intersectionEventList.numIntersections;
+  stats->numEvents = intersectionEventList.numIntersections;
+  for (int i = 0; i < collisionWorld->numPairTestCounters; i++) {
+    stats->numIntersectCalls += counters[i].numIntersectCalls;
+    stats->numBoxRejections += counters[i].numBoxRejections;
+  }
+  resolveEvents(collisionWorld, &intersectionEventList);
+  IntersectionEventList_deleteNodes(&intersectionEventList);
+}
+
+// Simulates one frame with the KineticEngine.  Only the pairs and walls due
+// are checked, and only their lines are moved up to the frame; the others
+// are left behind until something needs them (see settleLines), and then
+// land exactly where the other broadphases would have moved them.  Returns
+// false, before finding any event, if the engine cannot be rebuilt for lack
+// of memory; the frame is then left to the other broadphases.
+static bool updateLinesKinetic(CollisionWorld* collisionWorld) {
+  CollisionWorldFrameStats* stats = &collisionWorld->frameStats;
+  KineticEngine* engine = collisionWorld->kineticEngine;
+  PairList* pairList = collisionWorld->pairList;
+  Line** lines = collisionWorld->lines;
+  size_t numOfLines = collisionWorld->numOfLines;
+  double timeStep = collisionWorld->timeStep;
+  uint64_t frame = collisionWorld->frameCount;
+  memset(stats, 0, sizeof(CollisionWorldFrameStats));
+  lagLines(collisionWorld);
+
+  PHASE_BEGIN(PHASE_BUILD);
+  // Lines added since the last frame are appended to the pairs and the
+  // predictions, as long as the PairList can take them.
+  if (engine->built && engine->numLines == pairList->numLines
+      && pairList->numLines < numOfLines
+      && !PairList_isExpired(pairList, numOfLines)) {
+    for (size_t i = pairList->numLines; i < numOfLines; i++) {
+      update_box(lines[i], timeStep);
+    }
+    size_t firstPair = pairList->numPairs;
+    if (PairList_extend(pairList, lines, numOfLines)) {
+      KineticEngine_extend(engine, pairList, lines, numOfLines, firstPair,
+                           timeStep, frame);
+    } else {
+      engine->built = false;
+    }
+  }
+  stats->pairListRebuilt = KineticEngine_checkEscapes(engine, pairList, lines,
+                                                      numOfLines, timeStep,
+                                                      frame);
+  if (stats->pairListRebuilt) {
+    settleLines(collisionWorld, frame);
+    RefreshBoxesArgs args;
+    args.collisionWorld = collisionWorld;
+    args.check = false;
+    args.stale = false;
+    Parallel_forStatic(collisionWorld->capacity, refreshBoxesBlock, &args);
+    bool built = PairList_build(pairList, lines, numOfLines, timeStep,
+                                KINETIC_SKIN_FRAMES)
+        && KineticEngine_rebuild(engine, pairList, lines, numOfLines,
+                                 timeStep, frame);
+    if (!built) {
+      engine->built = false;
+      PHASE_END(PHASE_BUILD);
+      return false;
+    }
+  }
+  PHASE_END(PHASE_BUILD);
+
+  PHASE_BEGIN(PHASE_TRAVERSE);
+  IntersectionEventList intersectionEventList = IntersectionEventList_make();
+  stats->numIntersectCalls = KineticEngine_testDuePairs(
+      engine, lines, timeStep, frame, &intersectionEventList,
+      &stats->numBoxRejections);
+  PHASE_END(PHASE_TRAVERSE);
+  collisionWorld->numLineLineCollisions += intersectionEventList.numIntersections;
+  stats->numEvents = intersectionEventList.numIntersections;
+  stats->numCandidatePairs = pairList->numPairs;
+  stats->numPairListBuilds = pairList->numBuilds;
+
+  // The brute-force check looks at every line.
+  if (collisionWorld->verifyBroadphase) {
+    settleLines(collisionWorld, frame);
+  }
+  resolveEvents(collisionWorld, &intersectionEventList);
+  IntersectionEventNode* node = intersectionEventList.head;
+  while (node != NULL) {
+    KineticEngine_touch(engine, lineIndex(collisionWorld, node->l1));
+    KineticEngine_touch(engine, lineIndex(collisionWorld, node->l2));
+    node = node->next;
+  }
   IntersectionEventList_deleteNodes(&intersectionEventList);
+
+  // The walls are checked after the frame's position update.
+  PHASE_BEGIN(PHASE_WALL);
+  size_t numDue = KineticEngine_popDueWalls(engine, frame);
+  for (size_t i = 0; i < numDue; i++) {
+    size_t index = engine->dueWalls[i];
+    KineticEngine_advance(engine, lines, index, timeStep, frame + 1);
+    if (bounceOffWalls(lines[index])) {
+      collisionWorld->numLineWallCollisions++;
+      KineticEngine_touch(engine, index);
+    } else {
+      KineticEngine_keepWall(engine, lines, index, timeStep, frame);
+    }
+  }
+  PHASE_END(PHASE_WALL);
+
+  PHASE_BEGIN(PHASE_BUILD);
+  KineticEngine_predict(engine, pairList, lines, timeStep, frame + 1);
+  PHASE_END(PHASE_BUILD);
+  stats->numQueuedEvents = KineticEngine_getNumQueued(engine);
+  return true;
 }
 
-unsigned int CollisionWorld_getNumLineWallCollisions(
+// Returns the position of cell (x, y) of a HILBERT_SIDE by HILBERT_SIDE
+// grid along the Hilbert curve through it.
+static uint32_t hilbertIndex(uint32_t x, uint32_t y) {
+  uint32_t index = 0;
+  for (uint32_t s = HILBERT_SIDE / 2; s > 0; s /= 2) {
+    uint32_t rx = (x & s) > 0;
+    uint32_t ry = (y & s) > 0;
+    index += s * s * ((3 * rx) ^ ry);
+    // Turn the quadrant so that the curve through it starts and ends like
+    // the curve through the whole grid.
+    if (ry == 0) {
+      if (rx == 1) {
+        x = HILBERT_SIDE - 1 - x;
+        y = HILBERT_SIDE - 1 - y;
+      }
+      uint32_t temp = x;
+      x = y;
+      y = temp;
+    }
+  }
+  return index;
+}
+
+// Returns the grid cell along one axis of the Hilbert curve that holds the
+// coordinate.  Coordinates outside the box fall into the border cells.
+static inline uint32_t curveCellOf(double coordinate, double min,
+                                   double max) {
+  double cell = (coordinate - min) / (max - min) * HILBERT_SIDE;
+  if (!(cell > 0)) {
+    return 0;
+  }
+  if (cell >= HILBERT_SIDE - 1) {
+    return HILBERT_SIDE - 1;
+  }
+  return (uint32_t) cell;
+}
+
+// A line's position along the Hilbert curve.  Lines in the same cell are
+// ordered by ID.
+struct CurveEntry {
+  uint32_t index;
+  size_t slot;
+  uint64_t id;
+};
+typedef struct CurveEntry CurveEntry;
+
+static int compareCurveEntries(const void* a, const void* b) {
+  const CurveEntry* x = a;
+  const CurveEntry* y = b;
+  if (x->index != y->index) {
+    return (x->index > y->index) - (x->index < y->index);
+  }
+  return (x->id > y->id) - (x->id < y->id);
+}
+
+struct ReorderArgs {
+  CollisionWorld* collisionWorld;
+  CurveEntry* order;
+  Line* storage;
+};
+typedef struct ReorderArgs ReorderArgs;
+
+static void curveEntriesBlock(size_t begin, size_t end, void* arg) {
+  ReorderArgs* args = arg;
+  CollisionWorld* collisionWorld = args->collisionWorld;
+  if (end > collisionWorld->numOfLines) {
+    end = collisionWorld->numOfLines;
+  }
+  for (size_t i = begin; i < end; i++) {
+    Line* line = collisionWorld->lines[i];
+    uint32_t x = curveCellOf((line->p1.x + line->p2.x) / 2, BOX_XMIN,
+                             BOX_XMAX);
+    uint32_t y = curveCellOf((line->p1.y + line->p2.y) / 2, BOX_YMIN,
+                             BOX_YMAX);
+    args->order[i].index = hilbertIndex(x, y);
+    args->order[i].slot = i;
+    args->order[i].id = line->id;
+  }
+}
+
+// Fills the blocks of the new storage, in curve order, over the same blocks
+// as touchLines, so each one is first touched by the worker that updates it.
+static void gatherLinesBlock(size_t begin, size_t end, void* arg) {
+  ReorderArgs* args = arg;
+  CollisionWorld* collisionWorld = args->collisionWorld;
+  for (size_t i = begin; i < end; i++) {
+    Line* line = &args->storage[i];
+    if (i < collisionWorld->numOfLines) {
+      *line = collisionWorld->lineStorage[args->order[i].slot];
+    } else {
+      memset(line, 0, sizeof(Line));
+    }
+    collisionWorld->lines[i] = line;
+    collisionWorld->line_nodes[i]->line = line;
+  }
+}
+
+// Sorts the line storage along the Hilbert curve if too many neighbouring
+// lines are out of order.  The storage stays as it is if the sorted copy
+// cannot be allocated, to be checked again after the next interval.
+static void reorderLines(CollisionWorld* collisionWorld) {
+  size_t numOfLines = collisionWorld->numOfLines;
+  if (numOfLines < 2) {
+    return;
+  }
+  // This is the end of the frame, after its position update.
+  settleLines(collisionWorld, collisionWorld->frameCount + 1);
+  ReorderArgs args;
+  args.collisionWorld = collisionWorld;
+  args.order = malloc(numOfLines * sizeof(CurveEntry));
+  if (args.order == NULL) {
+    return;
+  }
+  Parallel_forStatic(collisionWorld->capacity, curveEntriesBlock, &args);
+
+  size_t numDisordered = 0;
+  for (size_t i = 1; i < numOfLines; i++) {
+    numDisordered += args.order[i - 1].index > args.order[i].index;
+  }
+  if (numDisordered * REORDER_DISORDER_RATIO <= numOfLines) {
+    free(args.order);
+    return;
+  }
+
+  args.storage = malloc(collisionWorld->capacity * sizeof(Line));
+  if (args.storage == NULL) {
+    free(args.order);
+    return;
+  }
+  qsort(args.order, numOfLines, sizeof(CurveEntry), compareCurveEntries);
+  Parallel_forStatic(collisionWorld->capacity, gatherLinesBlock, &args);
+  free(collisionWorld->lineStorage);
+  collisionWorld->lineStorage = args.storage;
+  for (size_t i = 0; i < numOfLines; i++) {
+    LineTable_set(collisionWorld->lineTable, args.order[i].id, i);
+  }
+  free(args.order);
+
+  // The structures that index the lines by slot are rebuilt at the next
+  // frame.
+  dropQueryTree(collisionWorld);
+  collisionWorld->pairList->valid = false;
+  collisionWorld->kineticEngine->built = false;
+  collisionWorld->staticIndex->valid = false;
+  collisionWorld->numReorders++;
+  collisionWorld->frameStats.linesReordered = true;
+  collisionWorld->frameStats.numReorders = collisionWorld->numReorders;
+}
+
+// Mixes a 64-bit word into the hash.
+static inline uint64_t hashWord(uint64_t hash, uint64_t word) {
+  hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+  return hash ^ (hash >> 32);
+}
+
+static inline uint64_t hashDouble(uint64_t hash, double value) {
+  uint64_t word;
+  memcpy(&word, &value, sizeof(word));
+  return hashWord(hash, word);
+}
+
+static int compareLinePointers(const void* a, const void* b) {
+  return compareLines(*(Line**) a, *(Line**) b);
+}
+
+uint64_t CollisionWorld_hashState(CollisionWorld* collisionWorld) {
+  settleLines(collisionWorld, collisionWorld->frameCount);
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  size_t numOfLines = collisionWorld->numOfLines;
+  hash = hashWord(hash, numOfLines);
+  hash = hashWord(hash, collisionWorld->numLineWallCollisions);
+  hash = hashWord(hash, collisionWorld->numLineLineCollisions);
+
+  // Lines are stored in ID order unless some were removed or added out of
+  // order, or the storage was re-sorted, in which case they are sorted into
+  // hashLines first.
+  Line** lines = collisionWorld->lines;
+  size_t i = 1;
+  while (i < numOfLines && lines[i - 1]->id < lines[i]->id) {
+    i++;
+  }
+  if (i < numOfLines) {
+    lines = collisionWorld->hashLines;
+    memcpy(lines, collisionWorld->lines, numOfLines * sizeof(Line*));
+    qsort(lines, numOfLines, sizeof(Line*), compareLinePointers);
+  }
+  for (i = 0; i < numOfLines; i++) {
+    Line* line = lines[i];
+    hash = hashWord(hash, line->id);
+    hash = hashDouble(hash, line->p1.x);
+    hash = hashDouble(hash, line->p1.y);
+    hash = hashDouble(hash, line->p2.x);
+    hash = hashDouble(hash, line->p2.y);
+    hash = hashDouble(hash, line->velocity.x);
+    hash = hashDouble(hash, line->velocity.y);
+  }
+  return hash;
+}
+
+// A checkpoint file is this header followed by the world's numLines Lines,
+// stored as they are in memory.
+#define CHECKPOINT_MAGIC 0x33544b5043574c43ULL  // "CLWCPKT3"
+
+struct CheckpointHeader {
+  uint64_t magic;
+  uint64_t lineSize;
+  uint64_t numLines;
+  uint64_t frameCount;
+  uint64_t numLineWallCollisions;
+  uint64_t numLineLineCollisions;
+  double timeStep;
+};
+typedef struct CheckpointHeader CheckpointHeader;
+
+bool CollisionWorld_saveCheckpoint(CollisionWorld* collisionWorld,
+                                   const char* path) {
+  settleLines(collisionWorld, collisionWorld->frameCount);
+  CheckpointHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = CHECKPOINT_MAGIC;
+  header.lineSize = sizeof(Line);
+  header.numLines = collisionWorld->numOfLines;
+  header.frameCount = collisionWorld->frameCount;
+  header.numLineWallCollisions = collisionWorld->numLineWallCollisions;
+  header.numLineLineCollisions = collisionWorld->numLineLineCollisions;
+  header.timeStep = collisionWorld->timeStep;
+
+  FILE* out = fopen(path, "wb");
+  if (out == NULL) {
+    return false;
+  }
+  bool written = fwrite(&header, sizeof(header), 1, out) == 1
+      && fwrite(collisionWorld->lineStorage, sizeof(Line), header.numLines,
+                out) == header.numLines;
+  return (fclose(out) == 0) && written;
+}
+
+CollisionWorld* CollisionWorld_newFromCheckpoint(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat status;
+  void* map = MAP_FAILED;
+  if (fstat(fd, &status) == 0
+      && (size_t) status.st_size >= sizeof(CheckpointHeader)) {
+    map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+
+  const CheckpointHeader* header = map;
+  CollisionWorld* collisionWorld = NULL;
+  if (header->magic == CHECKPOINT_MAGIC && header->lineSize == sizeof(Line)
+      && (status.st_size - sizeof(CheckpointHeader)) % sizeof(Line) == 0
+      && header->numLines
+          == (status.st_size - sizeof(CheckpointHeader)) / sizeof(Line)) {
+    // A world saved with no lines still needs room for one.
+    collisionWorld = CollisionWorld_new((header->numLines > 0)
+                                        ? header->numLines : 1);
+  }
+  if (collisionWorld != NULL) {
+    collisionWorld->numOfLines = header->numLines;
+    collisionWorld->frameCount = header->frameCount;
+    collisionWorld->numLineWallCollisions = header->numLineWallCollisions;
+    collisionWorld->numLineLineCollisions = header->numLineLineCollisions;
+    collisionWorld->timeStep = header->timeStep;
+    CopyLinesArgs args = { collisionWorld, (const Line*) (header + 1) };
+    Parallel_forStatic(collisionWorld->capacity, copyLinesBlock, &args);
+    // As in CollisionWorld_newFromArrays, the line table never grows here.
+    for (size_t i = 0; i < collisionWorld->numOfLines; i++) {
+      uint64_t id = collisionWorld->lines[i]->id;
+      LineTable_set(collisionWorld->lineTable, id, i);
+      if (id >= collisionWorld->nextLineId) {
+        collisionWorld->nextLineId = id + 1;
+      }
+    }
+  }
+  munmap(map, status.st_size);
+  return collisionWorld;
+}
+
+uint64_t CollisionWorld_getNumLineWallCollisions(
     CollisionWorld* collisionWorld) {
   return collisionWorld->numLineWallCollisions;
 }
 
-unsigned int CollisionWorld_getNumLineLineCollisions(
+uint64_t CollisionWorld_getNumLineLineCollisions(
     CollisionWorld* collisionWorld) {
   return collisionWorld->numLineLineCollisions;
 }
 
+void CollisionWorld_setBroadphase(CollisionWorld* collisionWorld,
+                                  Broadphase broadphase) {
+  collisionWorld->broadphase = broadphase;
+}
+
+Broadphase CollisionWorld_getBroadphase(CollisionWorld* collisionWorld) {
+  return collisionWorld->broadphase;
+}
+
+void CollisionWorld_setStaticPartition(CollisionWorld* collisionWorld,
+                                       bool staticPartition) {
+  collisionWorld->staticPartition = staticPartition;
+}
+
+void CollisionWorld_setKinetic(CollisionWorld* collisionWorld, bool kinetic) {
+  // The engine's predictions go stale while it is not in use.
+  if (kinetic && !collisionWorld->kinetic) {
+    collisionWorld->kineticEngine->built = false;
+  }
+  collisionWorld->kinetic = kinetic;
+}
+
+bool CollisionWorld_isKinetic(CollisionWorld* collisionWorld) {
+  return collisionWorld->kinetic;
+}
+
+void CollisionWorld_setReorderInterval(CollisionWorld* collisionWorld,
+                                       uint64_t interval) {
+  collisionWorld->reorderInterval = interval;
+}
+
+void CollisionWorld_setVerifyBroadphase(CollisionWorld* collisionWorld,
+                                        bool verifyBroadphase) {
+  collisionWorld->verifyBroadphase = verifyBroadphase;
+}
+
+uint64_t CollisionWorld_getNumBroadphaseMismatches(
+    CollisionWorld* collisionWorld) {
+  return collisionWorld->numBroadphaseMismatches;
+}
+
+void CollisionWorld_setCollectStats(CollisionWorld* collisionWorld,
+                                    bool collectStats) {
+  free(collisionWorld->pairTestCounters);
+  collisionWorld->pairTestCounters = NULL;
+  collisionWorld->numPairTestCounters = 0;
+  if (!collectStats) {
+    return;
+  }
+
+  int numWorkers = Parallel_getNumWorkers();
+  void* counters;
+  if (posix_memalign(&counters, sizeof(PairTestCounters),
+                     numWorkers * sizeof(PairTestCounters)) != 0) {
+    return;
+  }
+  memset(counters, 0, numWorkers * sizeof(PairTestCounters));
+  collisionWorld->pairTestCounters = counters;
+  collisionWorld->numPairTestCounters = numWorkers;
+}
+
+const CollisionWorldFrameStats* CollisionWorld_getFrameStats(
+    CollisionWorld* collisionWorld) {
+  return &collisionWorld->frameStats;
+}
+
+static void dropQueryTree(CollisionWorld* collisionWorld) {
+  if (collisionWorld->queryTree != NULL) {
+    quad_tree_delete(collisionWorld->queryTree);
+    collisionWorld->queryTree = NULL;
+  }
+}
+
+static quad_tree* getQueryTree(CollisionWorld* collisionWorld) {
+  if (collisionWorld->queryTree == NULL) {
+    settleLines(collisionWorld, collisionWorld->frameCount);
+    collisionWorld->queryTree = build_quadtree(collisionWorld);
+  }
+  return collisionWorld->queryTree;
+}
+
+size_t CollisionWorld_queryRect(CollisionWorld* collisionWorld,
+                                const QueryRect* rect, Line** results,
+                                size_t maxResults) {
+  return Query_rect(getQueryTree(collisionWorld), rect, results, maxResults);
+}
+
+size_t CollisionWorld_querySegment(CollisionWorld* collisionWorld,
+                                   const QuerySegment* segment,
+                                   Line** results, size_t maxResults) {
+  return Query_segment(getQueryTree(collisionWorld), segment, results,
+                       maxResults);
+}
+
+Line* CollisionWorld_queryNearest(CollisionWorld* collisionWorld, Vec point,
+                                  double* distance) {
+  return Query_nearest(getQueryTree(collisionWorld), point, distance);
+}
+
+// Number of queries of a batch handed to a worker at a time.
+#define QUERY_GRAIN 16
+
+// A batch of queries of one kind; the fields of the other kinds are NULL.
+struct QueryBatch {
+  quad_tree* tree;
+  const QueryRect* rects;
+  const QuerySegment* segments;
+  const Vec* points;
+  Line** results;
+  size_t maxPerQuery;
+  size_t* numResults;
+  double* distances;
+};
+typedef struct QueryBatch QueryBatch;
+
+static void runQueryBatch(size_t begin, size_t end, void* arg) {
+  QueryBatch* batch = arg;
+  for (size_t q = begin; q < end; q++) {
+    Line** results = batch->results + q * batch->maxPerQuery;
+    if (batch->rects != NULL) {
+      batch->numResults[q] = Query_rect(batch->tree, &batch->rects[q],
+                                        results, batch->maxPerQuery);
+    } else if (batch->segments != NULL) {
+      batch->numResults[q] = Query_segment(batch->tree, &batch->segments[q],
+                                           results, batch->maxPerQuery);
+    } else {
+      batch->results[q] = Query_nearest(batch->tree, batch->points[q],
+          (batch->distances != NULL) ? &batch->distances[q] : NULL);
+    }
+  }
+}
+
+void CollisionWorld_queryRects(CollisionWorld* collisionWorld,
+                               const QueryRect* rects,
+                               size_t numQueries, Line** results,
+                               size_t maxPerQuery, size_t* numResults) {
+  QueryBatch batch = { getQueryTree(collisionWorld), rects, NULL, NULL,
+                       results, maxPerQuery, numResults, NULL };
+  Parallel_for(numQueries, QUERY_GRAIN, runQueryBatch, &batch);
+}
+
+void CollisionWorld_querySegments(CollisionWorld* collisionWorld,
+                                  const QuerySegment* segments,
+                                  size_t numQueries, Line** results,
+                                  size_t maxPerQuery, size_t* numResults) {
+  QueryBatch batch = { getQueryTree(collisionWorld), NULL, segments, NULL,
+                       results, maxPerQuery, numResults, NULL };
+  Parallel_for(numQueries, QUERY_GRAIN, runQueryBatch, &batch);
+}
+
+void CollisionWorld_queryNearests(CollisionWorld* collisionWorld,
+                                  const Vec* points, size_t numQueries,
+                                  Line** nearest, double* distances) {
+  QueryBatch batch = { getQueryTree(collisionWorld), NULL, NULL, points,
+                       nearest, 1, NULL, distances };
+  Parallel_for(numQueries, QUERY_GRAIN, runQueryBatch, &batch);
+}
+
 void CollisionWorld_collisionSolver(CollisionWorld* collisionWorld, Line *l1,
                                     Line *l2, IntersectionType intersectionType) {
   assert(compareLines(l1, l2) < 0);
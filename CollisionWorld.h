@@ -24,96 +24,456 @@
 #ifndef COLLISIONWORLD_H_
 #define COLLISIONWORLD_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "./Line.h"
 #include "./IntersectionDetection.h"
+#include "./IntersectionEventList.h"
+#include "./EventLog.h"
+#include "./Kinetic.h"
+#include "./LineTable.h"
+#include "./PairList.h"
 #include "./Quadtree.h"
+#include "./Query.h"
+#include "./StaticIndex.h"
+
+// Number of quadtree levels tracked individually by the statistics.  Deeper
+// levels are counted in the last one.
+#define STATS_MAX_LEVELS 32
+
+// By default, the line storage is re-sorted along a Hilbert curve after
+// every REORDER_INTERVAL frames (see CollisionWorld_setReorderInterval).
+#define REORDER_INTERVAL 1024
+#define REORDER_DISORDER_RATIO 8
+
+// The ways of finding the pairs of lines tested by intersect.
+typedef enum {
+  // A quadtree is built and traversed every frame.
+  BROADPHASE_QUADTREE = 0,
+  // A PairList is built from time to time and its pairs are tested every
+  // frame.
+  BROADPHASE_PAIR_LIST = 1
+} Broadphase;
+
+// Statistics describing the most recent call to CollisionWorld_updateLines.
+struct CollisionWorldFrameStats {
+  // Number of line-line intersection events found in the frame.
+  size_t numEvents;
+
+  // Shape of the quadtree built for the frame, with BROADPHASE_QUADTREE, the
+  // number of static lines kept out of it, and the number of times the
+  // StaticIndex was built so far.
+  size_t numTreeNodes;
+  unsigned int maxTreeDepth;
+  size_t numStaticLines;
+  uint64_t numStaticIndexBuilds;
+
+  // With BROADPHASE_PAIR_LIST: the number of candidate pairs tested, whether
+  // the list was rebuilt for the frame, and the number of builds so far.
+  size_t numCandidatePairs;
+  bool pairListRebuilt;
+  uint64_t numPairListBuilds;
+
+  // With the KineticEngine, the number of events it has queued.
+  unsigned long long numQueuedEvents;
+
+  // Whether the line storage was re-sorted at the end of the frame, and the
+  // number of times it was so far.
+  bool linesReordered;
+  uint64_t numReorders;
+
+  // The remaining fields are only filled in while statistics collection is
+  // enabled with CollisionWorld_setCollectStats.
+
+  // Leaves of the quadtree, their mean depth, and the number of lines they
+  // hold relative to N.
+  size_t numLeaves;
+  double meanLeafDepth;
+  double meanLeafOccupancy;
+  double maxLeafOccupancy;
+
+  // Per level: number of nodes, number of MUL_TYPE lines stored at the
+  // level, and the total and largest number of upstream lines tested at its
+  // nodes after culling.
+  size_t numNodes[STATS_MAX_LEVELS];
+  size_t numStraddlers[STATS_MAX_LEVELS];
+  unsigned long long totalUpstream[STATS_MAX_LEVELS];
+  size_t maxUpstream[STATS_MAX_LEVELS];
+
+  // Number of calls to intersect, and how many of them were rejected by the
+  // bounding box test.
+  unsigned long long numIntersectCalls;
+  unsigned long long numBoxRejections;
+};
+typedef struct CollisionWorldFrameStats CollisionWorldFrameStats;
+
+// A line-line collision, as reported to a CollisionWorldEventCallback.
+struct CollisionEvent {
+  // The frame the collision was solved in, and the IDs of the two lines,
+  // id1 < id2.
+  uint64_t frame;
+  uint64_t id1, id2;
+  IntersectionType intersectionType;
+};
+typedef struct CollisionEvent CollisionEvent;
+
+// Receives the numEvents collisions of one or more consecutive frames, in
+// frame order and in the order they were solved within a frame.  The events
+// are only valid during the call.
+typedef void (*CollisionWorldEventCallback)(const CollisionEvent* events,
+                                            size_t numEvents, void* arg);
+
+// Pair-test counters of one worker.  Every worker adds to its own entry, so
+// the parallel traversal never contends on a counter, and the entries are
+// summed once the traversal is done.  Padded to a cache line.
+struct PairTestCounters {
+  unsigned long long numIntersectCalls;
+  unsigned long long numBoxRejections;
+  char padding[64 - 2 * sizeof(unsigned long long)];
+};
+typedef struct PairTestCounters PairTestCounters;
 
 struct CollisionWorld {
   // Time step used for simulation
   double timeStep;
   // Container that holds all the lines as an array of Line* lines.
-  // This CollisionWorld owns the Line* lines.
+  // This CollisionWorld owns the Line* lines.  The storage doubles when a
+  // line is added to a full world, and a removed line is replaced by the
+  // last one, so the lines always fill the first numOfLines slots.
   Line** lines;
   line_node** line_nodes;
-  unsigned int numOfLines;
+  size_t numOfLines;
+  size_t capacity;
+
+  // The slot of every line's ID, and one more than the largest ID added so
+  // far.
+  LineTable* lineTable;
+  uint64_t nextLineId;
+
+  // Frames between checks of the storage order, 0 if it is never checked,
+  // and the number of times the storage was re-sorted.
+  uint64_t reorderInterval;
+  uint64_t numReorders;
+
+  // Contiguous storage that lines and line_nodes point into.  Each worker
+  // first touches the block of lines it later updates every frame (see
+  // Parallel_forStatic), so on NUMA machines the block lives on its node.
+  Line* lineStorage;
+  line_node* lineNodeStorage;
+
+  // Storage for the quadtree's per-node arrays of lines, rebuilt every frame.
+  Line** treeLines;
+
+  // Scratch array in which CollisionWorld_hashState sorts the lines by ID,
+  // sized with the storage so that hashing never allocates.
+  Line** hashLines;
+
+  // Quadtree of the current positions answering the spatial queries, built
+  // by the first query after a frame or an added line, NULL until then.  It
+  // shares treeLines with the broadphase.
+  quad_tree* queryTree;
+
+  // The broadphase in use, and the candidate pairs of BROADPHASE_PAIR_LIST.
+  Broadphase broadphase;
+  PairList* pairList;
+
+  // Whether BROADPHASE_QUADTREE keeps the static lines, those moving at most
+  // STATIC_INDEX_MAX_SPEED per axis, in a StaticIndex, which it queries with
+  // the other lines, and the line_nodes of the other lines.
+  bool staticPartition;
+  StaticIndex* staticIndex;
+  line_node** dynamicNodes;
+
+  // Whether frames are simulated by the KineticEngine, which schedules its
+  // pair tests from the candidate pairs in pairList.
+  bool kinetic;
+  KineticEngine* kineticEngine;
+
+  // Whether the KineticEngine has left lines behind frameCount, at its
+  // positionFrames.  They are brought up to date before anything else reads
+  // their positions.
+  bool linesLag;
 
   // Record the total number of line-wall collisions.
-  unsigned int numLineWallCollisions;
+  uint64_t numLineWallCollisions;
 
   // Record the total number of line-line intersections.
-  unsigned int numLineLineCollisions;
+  uint64_t numLineLineCollisions;
+
+  // Number of frames simulated so far.
+  uint64_t frameCount;
+
+  // Whether to check the quadtree's events against a brute-force detector
+  // every frame, and the number of frames where the two disagreed.
+  bool verifyBroadphase;
+  uint64_t numBroadphaseMismatches;
+
+  // Statistics of the last frame.
+  CollisionWorldFrameStats frameStats;
+
+  // The callback receiving the collision events, NULL if none, and the
+  // events buffered for it.  Inside CollisionWorld_step the events of all the
+  // frames are delivered together.
+  CollisionWorldEventCallback eventCallback;
+  void* eventCallbackArg;
+  CollisionEvent* events;
+  size_t numEvents;
+  size_t eventCapacity;
+  bool deferEvents;
+
+  // The log every frame's events are written to, and the log whose events
+  // are applied instead of detecting them, or NULL.  Neither is owned.
+  EventLog* eventLog;
+  EventLog* replayLog;
+
+  // One entry per worker while statistics collection is enabled, NULL
+  // otherwise.
+  PairTestCounters* pairTestCounters;
+  int numPairTestCounters;
 };
 typedef struct CollisionWorld CollisionWorld;
 
-CollisionWorld* CollisionWorld_new(const unsigned int capacity);
+// Create an empty world with room for capacity lines.  Returns NULL if it
+// cannot be allocated.
+CollisionWorld* CollisionWorld_new(const size_t capacity);
 
 void CollisionWorld_delete(CollisionWorld* collisionWorld);
 
+// Create a world holding the numLines lines from p1[i] to p2[i] moving at
+// velocities[i], with IDs 0 to numLines - 1.  Coordinates are in the box
+// (see BOX_XMIN) and velocities in box units per time step.  colors may be
+// NULL, which makes every line RED.  The arrays are copied.  Returns NULL if
+// the world cannot be allocated.
+CollisionWorld* CollisionWorld_newFromArrays(const size_t numLines,
+                                             const Vec* p1, const Vec* p2,
+                                             const Vec* velocities,
+                                             const Color* colors);
+
 // Return the total number of lines in the box.
-unsigned int CollisionWorld_getNumOfLines(CollisionWorld* collisionWorld);
+size_t CollisionWorld_getNumOfLines(CollisionWorld* collisionWorld);
+
+// Add a line into the box, whose ID must not be in use.  The storage grows
+// if the world is full.
+// This CollisionWorld becomes owner of the Line* line: it is copied into the
+// world's storage and freed.  Returns false if the storage cannot grow, in
+// which case the world is unchanged and the caller still owns line.
+//
+// Lines can be added and removed between frames.  The StaticIndex, and at
+// the next frame the PairList and the KineticEngine, take added lines in
+// without a rebuild; a removal makes them rebuild at the next frame.
+bool CollisionWorld_addLine(CollisionWorld* collisionWorld, Line *line);
+
+// Add a line from p1 to p2 moving at velocity, with an ID larger than any
+// added before, and store the ID in *id.  Returns false, leaving the world
+// unchanged, if the line cannot be allocated.
+bool CollisionWorld_insertLine(CollisionWorld* collisionWorld, Vec p1, Vec p2,
+                               Vec velocity, Color color, uint64_t* id);
+
+// Remove the line with the given ID, moving the last line into its slot.
+// The candidate pairs, kinetic predictions and static index are patched
+// rather than rebuilt.  Returns false if there is no such line.
+bool CollisionWorld_removeLine(CollisionWorld* collisionWorld, uint64_t id);
 
-// Add a line into the box.  Must be under capacity.
-// This CollisionWorld becomes owner of the Line* line.
-void CollisionWorld_addLine(CollisionWorld* collisionWorld, Line *line);
+// Grow the storage to hold at least capacity lines.  Pointers to the lines
+// are invalidated; their IDs are not.  Returns false if the storage cannot
+// be allocated, in which case the lines stay where they are.
+bool CollisionWorld_reserve(CollisionWorld* collisionWorld,
+                            const size_t capacity);
 
-// Get a line from box.
+// Get a line from box.  The index of a line changes when another line is
+// removed.  With the KineticEngine, the line's position is only up to date
+// until the next frame.
 Line* CollisionWorld_getLine(CollisionWorld* collisionWorld,
-                             const unsigned int index);
+                             const size_t index);
+
+// Get the line with the given ID, or NULL if there is none.  The pointer is
+// valid until a line is added or removed.
+Line* CollisionWorld_findLine(CollisionWorld* collisionWorld, uint64_t id);
 
 // Update lines' situation in the box.
 void CollisionWorld_updateLines(CollisionWorld* collisionWorld);
 
+// Simulate numFrames frames, as many calls to CollisionWorld_updateLines
+// would, but deliver the collision events of all of them to the callback in
+// one call at the end.  With the KineticEngine, the frames without pairs to
+// test or walls to check are skipped, unless every frame is logged or
+// verified.
+void CollisionWorld_step(CollisionWorld* collisionWorld,
+                         const uint64_t numFrames);
+
+// Register the callback receiving the line-line collisions, or remove it if
+// callback is NULL.  Outside CollisionWorld_step, it is called at the end of
+// every frame that had collisions.  If the buffered events outgrow the
+// memory available, it is also called with them as soon as the buffer is
+// full.  arg is passed through to it.
+void CollisionWorld_setEventCallback(CollisionWorld* collisionWorld,
+                                     CollisionWorldEventCallback callback,
+                                     void* arg);
+
+// Write the sorted events of every following frame to log, or stop writing
+// them if log is NULL.  log must have been created for this world's number
+// of lines and next frame.
+void CollisionWorld_setEventLog(CollisionWorld* collisionWorld,
+                                EventLog* log);
+
+// Replay the following frames from log, or stop replaying if log is NULL:
+// instead of finding the frame's events, the logged ones are solved, so the
+// lines move exactly as in the logged run.  Once the log runs out, events
+// are detected again.  Returns false, and leaves replay off, if the log does
+// not start at the world's next frame or has another number of lines.
+bool CollisionWorld_setReplay(CollisionWorld* collisionWorld, EventLog* log);
+
 // Update position of lines.
 void CollisionWorld_updatePosition(CollisionWorld* collisionWorld);
 
 // Handle line-wall collision.
-static inline void CollisionWorld_lineWallCollision(CollisionWorld* collisionWorld) {
-  for (int i = 0; i < collisionWorld->numOfLines; i++) {
-    Line *line = collisionWorld->lines[i];
-    bool collide = false;
-
-    // Right side
-    if ((line->p1.x > BOX_XMAX || line->p2.x > BOX_XMAX)
-        && (line->velocity.x > 0)) {
-      line->velocity.x = -line->velocity.x;
-      collide = true;
-    }
-    // Left side
-    if ((line->p1.x < BOX_XMIN || line->p2.x < BOX_XMIN)
-        && (line->velocity.x < 0)) {
-      line->velocity.x = -line->velocity.x;
-      collide = true;
-    }
-    // Top side
-    if ((line->p1.y > BOX_YMAX || line->p2.y > BOX_YMAX)
-        && (line->velocity.y > 0)) {
-      line->velocity.y = -line->velocity.y;
-      collide = true;
-    }
-    // Bottom side
-    if ((line->p1.y < BOX_YMIN || line->p2.y < BOX_YMIN)
-        && (line->velocity.y < 0)) {
-      line->velocity.y = -line->velocity.y;
-      collide = true;
-    }
-    // Update total number of collisions.
-    if (collide == true) {
-      collisionWorld->numLineWallCollisions++;
-    }
-  }
-}
+void CollisionWorld_lineWallCollision(CollisionWorld* collisionWorld);
 
 // Detect line-line intersection.
 void CollisionWorld_detectIntersection(CollisionWorld* collisionWorld);
 
+// Build a quad_tree of all lines in the world.  The caller owns the
+// returned tree.
+quad_tree* build_quadtree(CollisionWorld* collision_world);
+
+// Compute the list of intersections within the given quad_tree, where the
+// stack of spans upstream holds the lines stored in the tree's ancestors.
+// The pair tests are estimated per subtree first and split into tasks of
+// similar work, which run in parallel.  Each child only tests the upstream
+// lines whose swept boxes reach its region; the stack it sees shares every
+// span that culling leaves whole.  If counters is not NULL, each worker adds
+// its pair tests to counters[worker number].
+IntersectionEventList CollisionWorld_getIntersectionEvents(quad_tree* tree,
+  double timeStep, const LineSpan* upstream, PairTestCounters* counters);
+
+// Compute the list of intersections among the candidate pairs of the given
+// PairList, in parallel.  If counters is not NULL, each worker adds its pair
+// tests to counters[worker number].
+IntersectionEventList CollisionWorld_getIntersectionEventsFromPairs(
+    PairList* pairList, double timeStep, PairTestCounters* counters);
+
+// Compute a 64-bit hash of every line's position and velocity, in line ID
+// order, and of the collision counters.  Two runs that are bit-for-bit
+// identical produce the same hash.
+uint64_t CollisionWorld_hashState(CollisionWorld* collisionWorld);
+
+// Write the world's lines, collision counters, time step and frame count to
+// a binary checkpoint file.  Returns false if the file cannot be written.
+bool CollisionWorld_saveCheckpoint(CollisionWorld* collisionWorld,
+                                   const char* path);
+
+// Create a world in the state saved by CollisionWorld_saveCheckpoint, which
+// simulates the following frames exactly as the saved world would have.  The
+// file is mapped into memory and each line is copied out of it once.
+// Returns NULL if the file cannot be read or was written by a build with a
+// different Line layout.
+CollisionWorld* CollisionWorld_newFromCheckpoint(const char* path);
+
 // Get total number of line-wall collisions.
-unsigned int CollisionWorld_getNumLineWallCollisions(
+uint64_t CollisionWorld_getNumLineWallCollisions(
     CollisionWorld* collisionWorld);
 
 // Get total number of line-line intersections.
-unsigned int CollisionWorld_getNumLineLineCollisions(
+uint64_t CollisionWorld_getNumLineLineCollisions(
     CollisionWorld* collisionWorld);
 
+// Compute the list of intersections by testing every pair of lines.  This is
+// the O(n^2) reference for the quadtree broadphase; it refreshes every
+// line's bounding box first.
+IntersectionEventList CollisionWorld_getIntersectionEventsBruteForce(
+    CollisionWorld* collisionWorld);
+
+// Select the broadphase used from the next frame on.  BROADPHASE_QUADTREE is
+// the default.
+void CollisionWorld_setBroadphase(CollisionWorld* collisionWorld,
+                                  Broadphase broadphase);
+
+// Get the broadphase in use.
+Broadphase CollisionWorld_getBroadphase(CollisionWorld* collisionWorld);
+
+// Enable or disable the static partition of BROADPHASE_QUADTREE, which is
+// enabled by default.  The lines moving at most STATIC_INDEX_MAX_SPEED along
+// each axis are binned once in a StaticIndex instead of being put into the
+// quadtree every frame.  A line that a collision speeds up leaves the index,
+// which is rebuilt once half of its lines have left, or after
+// STATIC_INDEX_MAX_FRAMES frames if it holds lines that are not still.
+void CollisionWorld_setStaticPartition(CollisionWorld* collisionWorld,
+                                       bool staticPartition);
+
+// Enable or disable simulating frames with the KineticEngine, which only
+// tests the pairs and checks the walls that the lines' velocities make
+// possible, and finds the same events as the broadphases.  The broadphase
+// setting is ignored while it is enabled.  The lines it does not need are
+// only moved when they are read, and CollisionWorld_step skips the frames in
+// which it has nothing to do.
+void CollisionWorld_setKinetic(CollisionWorld* collisionWorld, bool kinetic);
+
+// Get whether frames are simulated by the KineticEngine.
+bool CollisionWorld_isKinetic(CollisionWorld* collisionWorld);
+
+// Check the order of the line storage after every interval frames, or never
+// if interval is 0.  Lines that are near each other in the box drift apart
+// in the storage as they move.  If more than one in REORDER_DISORDER_RATIO
+// pairs of neighbouring slots are out of order along a Hilbert curve
+// through the box, the storage is sorted along the curve.
+// This only moves lines between slots: their IDs, and so the simulation,
+// are unchanged.
+void CollisionWorld_setReorderInterval(CollisionWorld* collisionWorld,
+                                       uint64_t interval);
+
+// Enable or disable checking the events found through the quadtree against
+// CollisionWorld_getIntersectionEventsBruteForce every frame.  The first
+// missing or extra event of every mismatching frame is reported on stderr.
+// A frame that cannot be checked for lack of memory counts as mismatching.
+void CollisionWorld_setVerifyBroadphase(CollisionWorld* collisionWorld,
+                                        bool verifyBroadphase);
+
+// Get the number of frames where the broadphase check found a mismatch.
+uint64_t CollisionWorld_getNumBroadphaseMismatches(
+    CollisionWorld* collisionWorld);
+
+// Enable or disable collection of the detailed quadtree and pair-test
+// statistics.
+void CollisionWorld_setCollectStats(CollisionWorld* collisionWorld,
+                                    bool collectStats);
+
+// Get the statistics of the most recently simulated frame.
+const CollisionWorldFrameStats* CollisionWorld_getFrameStats(
+    CollisionWorld* collisionWorld);
+
+// Spatial queries over the lines' current positions; see Query.h.  The
+// first query after a frame or an added line builds the quadtree they walk,
+// so queries must not run concurrently with each other or with a frame.
+// Lines changed through CollisionWorld_getLine are not seen until the next
+// frame.
+size_t CollisionWorld_queryRect(CollisionWorld* collisionWorld,
+                                const QueryRect* rect, Line** results,
+                                size_t maxResults);
+size_t CollisionWorld_querySegment(CollisionWorld* collisionWorld,
+                                   const QuerySegment* segment,
+                                   Line** results, size_t maxResults);
+Line* CollisionWorld_queryNearest(CollisionWorld* collisionWorld, Vec point,
+                                  double* distance);
+
+// Batches of the queries above, run in parallel.  Query q stores up to
+// maxPerQuery lines in results[q * maxPerQuery] onwards, and the number of
+// lines it found, which may exceed maxPerQuery, in numResults[q].
+void CollisionWorld_queryRects(CollisionWorld* collisionWorld,
+                               const QueryRect* rects,
+                               size_t numQueries, Line** results,
+                               size_t maxPerQuery, size_t* numResults);
+void CollisionWorld_querySegments(CollisionWorld* collisionWorld,
+                                  const QuerySegment* segments,
+                                  size_t numQueries, Line** results,
+                                  size_t maxPerQuery, size_t* numResults);
+
+// Batch of nearest-line queries, run in parallel.  Query q stores its line in
+// nearest[q] and, if distances is not NULL, its distance in distances[q].
+void CollisionWorld_queryNearests(CollisionWorld* collisionWorld,
+                                  const Vec* points, size_t numQueries,
+                                  Line** nearest, double* distances);
+
 // Update the two lines based on their intersection event.
 // Precondition: compareLines(l1, l2) < 0 must be true.
 void CollisionWorld_collisionSolver(CollisionWorld* collisionWorld, Line *l1,
@@ -0,0 +1,208 @@
+/**
+ * EventLog.c -- binary log of every frame's collision events
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./EventLog.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EVENT_LOG_MAGIC 0x33474f4c54564543ULL  // "CEVTLOG3"
+
+// Largest and smallest numbers of bytes of an encoded event: two 64-bit
+// varints and the type.
+#define EVENT_RECORD_MAX_SIZE 21
+#define EVENT_RECORD_MIN_SIZE 3
+
+struct EventLogHeader {
+  uint64_t magic;
+  uint64_t numLines;
+  uint64_t firstFrame;
+};
+typedef struct EventLogHeader EventLogHeader;
+
+// Numbers of events and of bytes of a frame.
+struct FrameHeader {
+  uint64_t numEvents;
+  uint64_t numBytes;
+};
+typedef struct FrameHeader FrameHeader;
+
+static EventLog* newLog(FILE* file, bool writing, uint64_t numLines,
+                        uint64_t firstFrame) {
+  EventLog* log = malloc(sizeof(EventLog));
+  if (log == NULL) {
+    fclose(file);
+    return NULL;
+  }
+  log->file = file;
+  log->writing = writing;
+  log->numLines = numLines;
+  log->firstFrame = firstFrame;
+  log->events = NULL;
+  log->numEvents = 0;
+  log->eventCapacity = 0;
+  log->bytes = NULL;
+  log->byteCapacity = 0;
+  return log;
+}
+
+EventLog* EventLog_create(const char* path, uint64_t numLines,
+                          uint64_t firstFrame) {
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    return NULL;
+  }
+  EventLogHeader header = { EVENT_LOG_MAGIC, numLines, firstFrame };
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    fclose(file);
+    return NULL;
+  }
+  return newLog(file, true, numLines, firstFrame);
+}
+
+EventLog* EventLog_open(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+  EventLogHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1
+      || header.magic != EVENT_LOG_MAGIC) {
+    fclose(file);
+    return NULL;
+  }
+  return newLog(file, false, header.numLines, header.firstFrame);
+}
+
+void EventLog_close(EventLog* log) {
+  fclose(log->file);
+  free(log->events);
+  free(log->bytes);
+  free(log);
+}
+
+static inline unsigned char* putVarint(unsigned char* cur, uint64_t value) {
+  while (value >= 0x80) {
+    *cur++ = (unsigned char) (value | 0x80);
+    value >>= 7;
+  }
+  *cur++ = (unsigned char) value;
+  return cur;
+}
+
+// Returns NULL if the varint runs past end.
+static inline const unsigned char* getVarint(const unsigned char* cur,
+                                             const unsigned char* end,
+                                             uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; cur < end && shift < 64; shift += 7) {
+    unsigned char byte = *cur++;
+    *value |= (uint64_t) (byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      return cur;
+    }
+  }
+  return NULL;
+}
+
+static bool reserveBytes(EventLog* log, size_t size) {
+  if (size <= log->byteCapacity) {
+    return true;
+  }
+  size_t capacity = 2 * log->byteCapacity;
+  if (capacity < size) {
+    capacity = size;
+  }
+  unsigned char* bytes = realloc(log->bytes, capacity);
+  if (bytes == NULL) {
+    return false;
+  }
+  log->bytes = bytes;
+  log->byteCapacity = capacity;
+  return true;
+}
+
+bool EventLog_writeFrame(EventLog* log, const IntersectionEventList* list) {
+  assert(log->writing);
+  if (!reserveBytes(log, (size_t) list->numIntersections
+                    * EVENT_RECORD_MAX_SIZE)) {
+    return false;
+  }
+
+  unsigned char* cur = log->bytes;
+  uint64_t previous = 0;
+  for (IntersectionEventNode* node = list->head; node != NULL;
+       node = node->next) {
+    assert(node->l1->id >= previous && node->l2->id > node->l1->id);
+    cur = putVarint(cur, node->l1->id - previous);
+    cur = putVarint(cur, node->l2->id - node->l1->id);
+    *cur++ = (unsigned char) node->intersectionType;
+    previous = node->l1->id;
+  }
+  FrameHeader frame = { list->numIntersections, cur - log->bytes };
+  return fwrite(&frame, sizeof(frame), 1, log->file) == 1
+      && fwrite(log->bytes, 1, frame.numBytes, log->file) == frame.numBytes;
+}
+
+bool EventLog_readFrame(EventLog* log) {
+  assert(!log->writing);
+  FrameHeader frame;
+  if (fread(&frame, sizeof(frame), 1, log->file) != 1
+      || frame.numEvents > frame.numBytes / EVENT_RECORD_MIN_SIZE
+      || !reserveBytes(log, frame.numBytes)) {
+    return false;
+  }
+  if (frame.numEvents > log->eventCapacity) {
+    LoggedEvent* events = realloc(log->events,
+                                  frame.numEvents * sizeof(LoggedEvent));
+    if (events == NULL) {
+      return false;
+    }
+    log->events = events;
+    log->eventCapacity = frame.numEvents;
+  }
+  if (frame.numBytes > 0
+      && fread(log->bytes, frame.numBytes, 1, log->file) != 1) {
+    return false;
+  }
+
+  const unsigned char* cur = log->bytes;
+  const unsigned char* end = log->bytes + frame.numBytes;
+  uint64_t previous = 0;
+  for (uint64_t i = 0; i < frame.numEvents; i++) {
+    uint64_t delta1, delta2;
+    cur = getVarint(cur, end, &delta1);
+    if (cur == NULL || (cur = getVarint(cur, end, &delta2)) == NULL
+        || cur == end) {
+      return false;
+    }
+    LoggedEvent* event = &log->events[i];
+    event->id1 = previous + delta1;
+    event->id2 = event->id1 + delta2;
+    event->intersectionType = (IntersectionType) *cur++;
+    previous = event->id1;
+  }
+  log->numEvents = frame.numEvents;
+  return cur == end;
+}
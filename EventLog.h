@@ -0,0 +1,87 @@
+/**
+ * EventLog.h -- binary log of every frame's collision events
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef EVENTLOG_H_
+#define EVENTLOG_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "./IntersectionDetection.h"
+#include "./IntersectionEventList.h"
+
+// An event log holds, for every frame simulated while it was written, the
+// frame's sorted line-line events as (l1 ID, l2 ID, IntersectionType)
+// records.  Each frame is stored as its number of events and of bytes,
+// followed by the records, whose IDs are varints: l1's ID as the difference
+// to the previous record's, and l2's as the difference to l1's.  The header
+// records the number of lines and the frame the log starts at.
+
+// One event read back from a log.
+struct LoggedEvent {
+  uint64_t id1;
+  uint64_t id2;
+  IntersectionType intersectionType;
+};
+typedef struct LoggedEvent LoggedEvent;
+
+struct EventLog {
+  FILE* file;
+  bool writing;
+
+  // Number of lines of the world, and the frame the log starts at.
+  uint64_t numLines;
+  uint64_t firstFrame;
+
+  // The events of the frame last read, and the encoding buffer of the frame
+  // last written.
+  LoggedEvent* events;
+  size_t numEvents;
+  size_t eventCapacity;
+  unsigned char* bytes;
+  size_t byteCapacity;
+};
+typedef struct EventLog EventLog;
+
+// Creates the log file at path for a world of numLines lines whose next
+// frame is firstFrame.  Returns NULL if the file cannot be created.
+EventLog* EventLog_create(const char* path, uint64_t numLines,
+                          uint64_t firstFrame);
+
+// Opens the log file at path for reading.  Returns NULL if the file cannot
+// be opened or is not an event log.
+EventLog* EventLog_open(const char* path);
+
+// Closes the file and deletes the log.
+void EventLog_close(EventLog* log);
+
+// Appends a frame with the events of the sorted list.  Returns false if the
+// file cannot be written.
+bool EventLog_writeFrame(EventLog* log, const IntersectionEventList* list);
+
+// Reads the next frame's events into log->events and log->numEvents.
+// Returns false at the end of the log or if it is truncated.
+bool EventLog_readFrame(EventLog* log);
+
+#endif  // EVENTLOG_H_
@@ -33,6 +33,13 @@ typedef enum {
   ALREADY_INTERSECTED
 } IntersectionType;
 
+// Quick detect if two lines intersect using the bounding boxes of their
+// sweeps over the next time step.
+static inline bool rectangles_overlap(Line* l1, Line* l2) {
+  return (l1->l_x <= l2->u_x) && (l1->u_x >= l2->l_x) \
+    && (l1->l_y <= l2->u_y) && (l1->u_y >= l2->l_y);
+}
+
 // Detect if line l1 and l2 will be intersected in the next time step.
 // Precondition: compareLines(l1, l2) < 0 must be true.
 IntersectionType intersect(Line *l1, Line *l2, double time);
@@ -23,6 +23,7 @@
 #include "./IntersectionEventList.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 int IntersectionEventNode_compareData(IntersectionEventNode* node1,
@@ -108,6 +109,115 @@ void IntersectionEventList_mergeLists(IntersectionEventList* list1, Intersection
   list2->numIntersections = 0;
 }
 
+// An event and its sort key: the ranks of l1's and l2's IDs, in the high and
+// low 32 bits.
+struct KeyedEvent {
+  uint64_t key;
+  IntersectionEventNode* node;
+};
+typedef struct KeyedEvent KeyedEvent;
+
+static int compareIds(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+  return (x > y) - (x < y);
+}
+
+static int compareKeys(const void* a, const void* b) {
+  return compareIds(&((const KeyedEvent*) a)->key,
+                    &((const KeyedEvent*) b)->key);
+}
+
+// Returns the index of id in the sorted array ids, which holds it.
+static uint64_t rankOf(const uint64_t* ids, size_t numIds, uint64_t id) {
+  size_t low = 0;
+  size_t high = numIds;
+  while (high - low > 1) {
+    size_t middle = low + (high - low) / 2;
+    if (ids[middle] <= id) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+  assert(ids[low] == id);
+  return low;
+}
+
+// Sorts the list in place with a selection sort, which needs no memory.
+static void selectionSort(IntersectionEventList* intersectionEventList) {
+  IntersectionEventNode* startNode = intersectionEventList->head;
+  while (startNode != NULL) {
+    IntersectionEventNode* minNode = startNode;
+    IntersectionEventNode* curNode = startNode->next;
+    while (curNode != NULL) {
+      if (IntersectionEventNode_compareData(curNode, minNode) < 0) {
+        minNode = curNode;
+      }
+      curNode = curNode->next;
+    }
+    if (minNode != startNode) {
+      IntersectionEventNode_swapData(minNode, startNode);
+    }
+    startNode = startNode->next;
+  }
+}
+
+void IntersectionEventList_sort(IntersectionEventList* intersectionEventList) {
+  size_t numEvents = intersectionEventList->numIntersections;
+  if (numEvents < 2) {
+    return;
+  }
+  uint64_t* ids = malloc(2 * numEvents * sizeof(uint64_t));
+  KeyedEvent* events = malloc(numEvents * sizeof(KeyedEvent));
+  if (ids == NULL || events == NULL) {
+    free(events);
+    free(ids);
+    selectionSort(intersectionEventList);
+    return;
+  }
+
+  size_t numIds = 0;
+  for (IntersectionEventNode* node = intersectionEventList->head;
+       node != NULL; node = node->next) {
+    ids[numIds++] = node->l1->id;
+    ids[numIds++] = node->l2->id;
+  }
+  qsort(ids, numIds, sizeof(uint64_t), compareIds);
+  size_t numDistinct = 1;
+  for (size_t i = 1; i < numIds; i++) {
+    if (ids[i] != ids[numDistinct - 1]) {
+      ids[numDistinct++] = ids[i];
+    }
+  }
+  if (numDistinct > ((uint64_t) 1 << 32)) {
+    // The ranks would not fit in half a key.
+    free(events);
+    free(ids);
+    selectionSort(intersectionEventList);
+    return;
+  }
+
+  size_t e = 0;
+  for (IntersectionEventNode* node = intersectionEventList->head;
+       node != NULL; node = node->next) {
+    events[e].key = (rankOf(ids, numDistinct, node->l1->id) << 32)
+        | rankOf(ids, numDistinct, node->l2->id);
+    events[e].node = node;
+    e++;
+  }
+  qsort(events, numEvents, sizeof(KeyedEvent), compareKeys);
+
+  for (size_t i = 0; i + 1 < numEvents; i++) {
+    events[i].node->next = events[i + 1].node;
+  }
+  events[numEvents - 1].node->next = NULL;
+  intersectionEventList->head = events[0].node;
+  intersectionEventList->tail = events[numEvents - 1].node;
+  free(events);
+  free(ids);
+}
+
 void IntersectionEventList_deleteNodes(
     IntersectionEventList* intersectionEventList) {
   IntersectionEventNode* curNode = intersectionEventList->head;
@@ -23,6 +23,8 @@
 #ifndef INTERSECTIONEVENTLIST_H_
 #define INTERSECTIONEVENTLIST_H_
 
+#include <stddef.h>
+
 #include "./Line.h"
 #include "./IntersectionDetection.h"
 
@@ -49,7 +51,7 @@ void IntersectionEventNode_swapData(IntersectionEventNode* node1,
 struct IntersectionEventList {
   IntersectionEventNode* head;
   IntersectionEventNode* tail;
-  int numIntersections;
+  size_t numIntersections;
 };
 typedef struct IntersectionEventList IntersectionEventList;
 
@@ -66,6 +68,12 @@ void IntersectionEventList_appendNode(
     IntersectionEventList* intersectionEventList, Line* l1, Line* l2,
     IntersectionType intersectionType);
 
+// Sorts the list in the order of IntersectionEventNode_compareData.  The
+// lines' 64-bit IDs are first remapped to their dense ranks among the IDs in
+// the list, so every event is sorted by a single 64-bit key.  If the keys
+// cannot be allocated, the list is selection-sorted in place instead.
+void IntersectionEventList_sort(IntersectionEventList* intersectionEventList);
+
 // Deletes all the nodes in the list.
 void IntersectionEventList_deleteNodes(
     IntersectionEventList* intersectionEventList);
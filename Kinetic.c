@@ -0,0 +1,628 @@
+/**
+ * Kinetic.c -- event-driven scheduling of pair tests and wall checks
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./Kinetic.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include "./IntersectionDetection.h"
+
+// Slack, in box units, for the rounding of positions and boxes from frame to
+// frame.
+#define KINETIC_SLACK (8 * DBL_EPSILON)
+
+// Predictions are capped at this many frames ahead.
+#define KINETIC_MAX_WAIT (1u << 30)
+
+// A queue is compacted once it holds this many times as many events as it
+// can have valid ones, plus KINETIC_COMPACT_MIN.
+#define KINETIC_COMPACT_FACTOR 4
+#define KINETIC_COMPACT_MIN 1024
+
+// Returns false, leaving the queue unchanged, if it cannot grow.
+static bool queuePush(KineticQueue* queue, KineticEvent event) {
+  if (queue->size == queue->capacity) {
+    size_t capacity = (queue->capacity > 0) ? 2 * queue->capacity : 1024;
+    KineticEvent* events = realloc(queue->events,
+                                   capacity * sizeof(KineticEvent));
+    if (events == NULL) {
+      return false;
+    }
+    queue->events = events;
+    queue->capacity = capacity;
+  }
+  size_t i = queue->size++;
+  while (i > 0 && queue->events[(i - 1) / 2].frame > event.frame) {
+    queue->events[i] = queue->events[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  queue->events[i] = event;
+  return true;
+}
+
+static void siftDown(KineticQueue* queue, size_t i) {
+  KineticEvent event = queue->events[i];
+  while (2 * i + 1 < queue->size) {
+    size_t child = 2 * i + 1;
+    if (child + 1 < queue->size
+        && queue->events[child + 1].frame < queue->events[child].frame) {
+      child++;
+    }
+    if (queue->events[child].frame >= event.frame) {
+      break;
+    }
+    queue->events[i] = queue->events[child];
+    i = child;
+  }
+  queue->events[i] = event;
+}
+
+static inline bool queueHasDue(const KineticQueue* queue, uint64_t frame) {
+  return queue->size > 0 && queue->events[0].frame <= frame;
+}
+
+static KineticEvent queuePop(KineticQueue* queue) {
+  KineticEvent top = queue->events[0];
+  queue->events[0] = queue->events[--queue->size];
+  if (queue->size > 0) {
+    siftDown(queue, 0);
+  }
+  return top;
+}
+
+static inline bool isValidPairEvent(const KineticEngine* engine,
+                                    const KineticEvent* event) {
+  return engine->stamps[event->a] == event->stampA
+      && engine->stamps[event->b] == event->stampB;
+}
+
+static inline bool isValidLineEvent(const KineticEngine* engine,
+                                    const KineticEvent* event) {
+  return engine->stamps[event->a] == event->stampA;
+}
+
+// Drops the invalidated events of the queue, if there are many.
+static void compactQueue(KineticEngine* engine, KineticQueue* queue,
+                         size_t maxValid, bool pairs) {
+  if (queue->size <= KINETIC_COMPACT_FACTOR * maxValid + KINETIC_COMPACT_MIN) {
+    return;
+  }
+  size_t size = 0;
+  for (size_t i = 0; i < queue->size; i++) {
+    KineticEvent* event = &queue->events[i];
+    if (pairs ? isValidPairEvent(engine, event)
+              : isValidLineEvent(engine, event)) {
+      queue->events[size++] = *event;
+    }
+  }
+  queue->size = size;
+  for (size_t i = size / 2; i-- > 0;) {
+    siftDown(queue, i);
+  }
+}
+
+// Returns how many whole frames surely pass before a gap that shrinks by at
+// most rate per frame closes.
+static uint64_t framesBefore(double gap, double rate) {
+  gap -= KINETIC_SLACK;
+  rate += KINETIC_SLACK;
+  if (gap <= 0) {
+    return 0;
+  }
+  double frames = floor(gap / rate);
+  if (frames >= KINETIC_MAX_WAIT) {
+    return KINETIC_MAX_WAIT;
+  }
+  return (frames >= 1) ? (uint64_t) frames - 1 : 0;
+}
+
+static inline uint64_t min64(uint64_t a, uint64_t b) {
+  return (a < b) ? a : b;
+}
+
+static inline uint64_t max64(uint64_t a, uint64_t b) {
+  return (a > b) ? a : b;
+}
+
+// Frames before the swept boxes of the two lines, which must be up to date,
+// can overlap.
+static uint64_t framesBeforeOverlap(const Line* a, const Line* b,
+                                    double timeStep) {
+  double gapX = fmax(b->l_x - a->u_x, a->l_x - b->u_x);
+  double gapY = fmax(b->l_y - a->u_y, a->l_y - b->u_y);
+  double rateX = (fabs(a->velocity.x) + fabs(b->velocity.x)) * timeStep;
+  double rateY = (fabs(a->velocity.y) + fabs(b->velocity.y)) * timeStep;
+  return max64(framesBefore(gapX, rateX), framesBefore(gapY, rateY));
+}
+
+// Frames before the wall check after a position update can find the line
+// past a wall it is moving towards.
+static uint64_t framesBeforeWall(const Line* line, double timeStep) {
+  uint64_t wait = KINETIC_MAX_WAIT;
+  double rateX = fabs(line->velocity.x) * timeStep;
+  double rateY = fabs(line->velocity.y) * timeStep;
+  if (line->velocity.x > 0) {
+    wait = min64(wait, framesBefore(
+        BOX_XMAX - fmax(line->p1.x, line->p2.x), rateX));
+  } else if (line->velocity.x < 0) {
+    wait = min64(wait, framesBefore(
+        fmin(line->p1.x, line->p2.x) - BOX_XMIN, rateX));
+  }
+  if (line->velocity.y > 0) {
+    wait = min64(wait, framesBefore(
+        BOX_YMAX - fmax(line->p1.y, line->p2.y), rateY));
+  } else if (line->velocity.y < 0) {
+    wait = min64(wait, framesBefore(
+        fmin(line->p1.y, line->p2.y) - BOX_YMIN, rateY));
+  }
+  return wait;
+}
+
+// Frames before the swept box of line index, which must be up to date, can
+// leave its grown box in the PairList.
+static uint64_t framesBeforeEscape(const PairList* pairList,
+                                   size_t index, const Line* line,
+                                   double timeStep) {
+  const PairListBox* box = &pairList->boxes[index];
+  uint64_t wait = KINETIC_MAX_WAIT;
+  double rateX = fabs(line->velocity.x) * timeStep;
+  double rateY = fabs(line->velocity.y) * timeStep;
+  if (line->velocity.x > 0) {
+    wait = min64(wait, framesBefore(box->u_x - line->u_x, rateX));
+  } else if (line->velocity.x < 0) {
+    wait = min64(wait, framesBefore(line->l_x - box->l_x, rateX));
+  }
+  if (line->velocity.y > 0) {
+    wait = min64(wait, framesBefore(box->u_y - line->u_y, rateY));
+  } else if (line->velocity.y < 0) {
+    wait = min64(wait, framesBefore(line->l_y - box->l_y, rateY));
+  }
+  return wait;
+}
+
+// Schedules the test of lines a and b, which are ordered by compareLines, at
+// frame.  An event that cannot be queued leaves the engine to be rebuilt.
+static void schedulePair(KineticEngine* engine, size_t a,
+                         size_t b, uint64_t frame) {
+  KineticEvent event = { frame, a, b, engine->stamps[a], engine->stamps[b] };
+  if (!queuePush(&engine->pairQueue, event)) {
+    engine->built = false;
+  }
+}
+
+static void scheduleLine(KineticEngine* engine, KineticQueue* queue,
+                         size_t index, uint64_t frame) {
+  KineticEvent event = { frame, index, index, engine->stamps[index],
+                         engine->stamps[index] };
+  if (!queuePush(queue, event)) {
+    engine->built = false;
+  }
+}
+
+KineticEngine* KineticEngine_new(size_t capacity) {
+  KineticEngine* engine = calloc(1, sizeof(KineticEngine));
+  if (engine == NULL) {
+    return NULL;
+  }
+  engine->stamps = calloc(capacity, sizeof(uint64_t));
+  engine->touched = calloc(capacity, sizeof(bool));
+  engine->touchedLines = malloc(capacity * sizeof(size_t));
+  engine->neighborStart = malloc((capacity + 1) * sizeof(size_t));
+  engine->dueWalls = malloc(capacity * sizeof(size_t));
+  engine->positionFrames = malloc(capacity * sizeof(uint64_t));
+  engine->capacity = capacity;
+  engine->built = false;
+  if (engine->stamps == NULL || engine->touched == NULL
+      || engine->touchedLines == NULL || engine->neighborStart == NULL
+      || engine->dueWalls == NULL || engine->positionFrames == NULL) {
+    KineticEngine_delete(engine);
+    return NULL;
+  }
+  return engine;
+}
+
+void KineticEngine_delete(KineticEngine* engine) {
+  if (engine == NULL) {
+    return;
+  }
+  free(engine->pairQueue.events);
+  free(engine->wallQueue.events);
+  free(engine->escapeQueue.events);
+  free(engine->stamps);
+  free(engine->touched);
+  free(engine->touchedLines);
+  free(engine->neighborStart);
+  free(engine->neighbors);
+  free(engine->dueWalls);
+  free(engine->positionFrames);
+  free(engine);
+}
+
+bool KineticEngine_checkEscapes(KineticEngine* engine,
+                                const PairList* pairList, Line** lines,
+                                size_t numLines, double timeStep,
+                                uint64_t frame) {
+  if (!engine->built || engine->numLines != numLines
+      || pairList->numLines != numLines) {
+    return true;
+  }
+  while (queueHasDue(&engine->escapeQueue, frame)) {
+    KineticEvent event = queuePop(&engine->escapeQueue);
+    if (!isValidLineEvent(engine, &event)) {
+      continue;
+    }
+    KineticEngine_advance(engine, lines, event.a, timeStep, frame);
+    Line* line = lines[event.a];
+    update_box(line, timeStep);
+    if (!PairList_holds(pairList, event.a, line)) {
+      return true;
+    }
+    event.frame = frame + max64(1, framesBeforeEscape(pairList, event.a,
+                                                      line, timeStep));
+    if (!queuePush(&engine->escapeQueue, event)) {
+      engine->built = false;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Gathers each line's neighbors in the candidate pairs.  Returns false if
+// they cannot be allocated.
+static bool gatherNeighbors(KineticEngine* engine, const PairList* pairList,
+                            size_t numLines) {
+  size_t* start = engine->neighborStart;
+  for (size_t i = 0; i <= numLines; i++) {
+    start[i] = 0;
+  }
+  for (size_t p = 0; p < pairList->numPairs; p++) {
+    start[pairList->pairs[p].i1 + 1]++;
+    start[pairList->pairs[p].i2 + 1]++;
+  }
+  for (size_t i = 0; i < numLines; i++) {
+    start[i + 1] += start[i];
+  }
+  if (start[numLines] > engine->numNeighbors) {
+    size_t* neighbors = malloc(start[numLines] * sizeof(size_t));
+    if (neighbors == NULL) {
+      return false;
+    }
+    free(engine->neighbors);
+    engine->neighbors = neighbors;
+  }
+  engine->numNeighbors = start[numLines];
+  for (size_t p = 0; p < pairList->numPairs; p++) {
+    const LinePair* pair = &pairList->pairs[p];
+    engine->neighbors[start[pair->i1]++] = pair->i2;
+    engine->neighbors[start[pair->i2]++] = pair->i1;
+  }
+  // Filling moved every start up to the next line's start.
+  for (size_t i = numLines; i > 0; i--) {
+    start[i] = start[i - 1];
+  }
+  start[0] = 0;
+  return true;
+}
+
+bool KineticEngine_rebuild(KineticEngine* engine, const PairList* pairList,
+                           Line** lines, size_t numLines,
+                           double timeStep, uint64_t frame) {
+  assert(numLines <= engine->capacity);
+  engine->pairQueue.size = 0;
+  engine->wallQueue.size = 0;
+  engine->escapeQueue.size = 0;
+  engine->numLines = numLines;
+  for (size_t i = 0; i < engine->numTouched; i++) {
+    engine->touched[engine->touchedLines[i]] = false;
+  }
+  engine->numTouched = 0;
+
+  engine->built = gatherNeighbors(engine, pairList, numLines);
+  if (!engine->built) {
+    return false;
+  }
+  for (size_t p = 0; p < pairList->numPairs; p++) {
+    const LinePair* pair = &pairList->pairs[p];
+    schedulePair(engine, pair->i1, pair->i2,
+                 frame + framesBeforeOverlap(pair->l1, pair->l2, timeStep));
+  }
+  for (size_t i = 0; i < numLines; i++) {
+    scheduleLine(engine, &engine->wallQueue, i,
+                 frame + framesBeforeWall(lines[i], timeStep));
+    scheduleLine(engine, &engine->escapeQueue, i,
+                 frame + max64(1, framesBeforeEscape(pairList, i, lines[i],
+                                                     timeStep)));
+  }
+  return engine->built;
+}
+
+void KineticEngine_extend(KineticEngine* engine, const PairList* pairList,
+                          Line** lines, size_t numLines,
+                          size_t firstPair, double timeStep,
+                          uint64_t frame) {
+  assert(engine->built && pairList->numLines == numLines);
+  assert(numLines <= engine->capacity);
+  if (!gatherNeighbors(engine, pairList, numLines)) {
+    engine->built = false;
+    return;
+  }
+  for (size_t p = firstPair; p < pairList->numPairs; p++) {
+    const LinePair* pair = &pairList->pairs[p];
+    // The older line of the pair may have been left behind.
+    KineticEngine_advance(engine, lines, pair->i1, timeStep, frame);
+    KineticEngine_advance(engine, lines, pair->i2, timeStep, frame);
+    update_box(pair->l1, timeStep);
+    update_box(pair->l2, timeStep);
+    schedulePair(engine, pair->i1, pair->i2,
+                 frame + framesBeforeOverlap(pair->l1, pair->l2, timeStep));
+  }
+  for (size_t i = engine->numLines; i < numLines; i++) {
+    scheduleLine(engine, &engine->wallQueue, i,
+                 frame + framesBeforeWall(lines[i], timeStep));
+    scheduleLine(engine, &engine->escapeQueue, i,
+                 frame + max64(1, framesBeforeEscape(pairList, i, lines[i],
+                                                     timeStep)));
+  }
+  engine->numLines = numLines;
+}
+
+// Drops the events of line i from the queue and moves those of line last to
+// slot i.
+static void removeFromQueue(KineticQueue* queue, size_t i, size_t last) {
+  size_t size = 0;
+  for (size_t e = 0; e < queue->size; e++) {
+    KineticEvent event = queue->events[e];
+    if (event.a == i || event.b == i) {
+      continue;
+    }
+    if (event.a == last) {
+      event.a = i;
+    }
+    if (event.b == last) {
+      event.b = i;
+    }
+    queue->events[size++] = event;
+  }
+  queue->size = size;
+  for (size_t e = size / 2; e-- > 0;) {
+    siftDown(queue, e);
+  }
+}
+
+void KineticEngine_removeLine(KineticEngine* engine, const PairList* pairList,
+                              size_t i, size_t last) {
+  assert(i <= last);
+  if (!engine->built || i >= engine->numLines) {
+    return;
+  }
+  // Lines are only removed between frames, when none is touched.
+  if (engine->numLines != last + 1 || !pairList->valid
+      || pairList->numLines != last || engine->numTouched > 0) {
+    engine->built = false;
+    return;
+  }
+  removeFromQueue(&engine->pairQueue, i, last);
+  removeFromQueue(&engine->wallQueue, i, last);
+  removeFromQueue(&engine->escapeQueue, i, last);
+  engine->stamps[i] = engine->stamps[last];
+  engine->numLines = last;
+  if (!gatherNeighbors(engine, pairList, last)) {
+    engine->built = false;
+  }
+}
+
+bool KineticEngine_grow(KineticEngine* engine, size_t capacity) {
+  assert(capacity >= engine->capacity);
+  // The arrays that did grow are kept: they hold the same entries, and the
+  // capacity only changes once all of them have grown.
+  uint64_t* stamps = realloc(engine->stamps, capacity * sizeof(uint64_t));
+  if (stamps != NULL) {
+    engine->stamps = stamps;
+  }
+  bool* touched = realloc(engine->touched, capacity * sizeof(bool));
+  if (touched != NULL) {
+    engine->touched = touched;
+  }
+  size_t* touchedLines = realloc(engine->touchedLines,
+                                 capacity * sizeof(size_t));
+  if (touchedLines != NULL) {
+    engine->touchedLines = touchedLines;
+  }
+  size_t* neighborStart = realloc(engine->neighborStart,
+                                  (capacity + 1) * sizeof(size_t));
+  if (neighborStart != NULL) {
+    engine->neighborStart = neighborStart;
+  }
+  size_t* dueWalls = realloc(engine->dueWalls, capacity * sizeof(size_t));
+  if (dueWalls != NULL) {
+    engine->dueWalls = dueWalls;
+  }
+  uint64_t* positionFrames = realloc(engine->positionFrames,
+                                     capacity * sizeof(uint64_t));
+  if (positionFrames != NULL) {
+    engine->positionFrames = positionFrames;
+  }
+  if (stamps == NULL || touched == NULL || touchedLines == NULL
+      || neighborStart == NULL || dueWalls == NULL
+      || positionFrames == NULL) {
+    return false;
+  }
+  for (size_t i = engine->capacity; i < capacity; i++) {
+    engine->stamps[i] = 0;
+    engine->touched[i] = false;
+  }
+  engine->capacity = capacity;
+  return true;
+}
+
+unsigned long long KineticEngine_testDuePairs(
+    KineticEngine* engine, Line** lines, double timeStep, uint64_t frame,
+    IntersectionEventList* intersectionEventList,
+    unsigned long long* numBoxRejections) {
+  unsigned long long numTests = 0;
+  while (queueHasDue(&engine->pairQueue, frame)) {
+    KineticEvent event = queuePop(&engine->pairQueue);
+    if (!isValidPairEvent(engine, &event)) {
+      continue;
+    }
+    KineticEngine_advance(engine, lines, event.a, timeStep, frame);
+    KineticEngine_advance(engine, lines, event.b, timeStep, frame);
+    Line* l1 = lines[event.a];
+    Line* l2 = lines[event.b];
+    update_box(l1, timeStep);
+    update_box(l2, timeStep);
+    numTests++;
+    *numBoxRejections += !rectangles_overlap(l1, l2);
+    IntersectionType intersectionType = intersect(l1, l2, timeStep);
+    if (intersectionType != NO_INTERSECTION) {
+      IntersectionEventList_appendNode(intersectionEventList, l1, l2,
+                                       intersectionType);
+    }
+    event.frame = frame + max64(1, framesBeforeOverlap(l1, l2, timeStep));
+    if (!queuePush(&engine->pairQueue, event)) {
+      engine->built = false;
+    }
+  }
+  return numTests;
+}
+
+void KineticEngine_touch(KineticEngine* engine, size_t index) {
+  if (!engine->touched[index]) {
+    engine->touched[index] = true;
+    engine->touchedLines[engine->numTouched++] = index;
+    engine->stamps[index]++;
+  }
+}
+
+size_t KineticEngine_popDueWalls(KineticEngine* engine, uint64_t frame) {
+  size_t numDue = 0;
+  for (size_t i = 0; i < engine->numTouched; i++) {
+    engine->dueWalls[numDue++] = engine->touchedLines[i];
+  }
+  // Touched lines have had their events invalidated, so no line is stored
+  // twice.
+  while (queueHasDue(&engine->wallQueue, frame)) {
+    KineticEvent event = queuePop(&engine->wallQueue);
+    if (isValidLineEvent(engine, &event)) {
+      engine->dueWalls[numDue++] = event.a;
+    }
+  }
+  return numDue;
+}
+
+void KineticEngine_keepWall(KineticEngine* engine, Line** lines,
+                            size_t index, double timeStep,
+                            uint64_t frame) {
+  if (engine->touched[index]) {
+    return;
+  }
+  // The next check can come after the position update of frame + 1.
+  scheduleLine(engine, &engine->wallQueue, index,
+               frame + 1 + framesBeforeWall(lines[index], timeStep));
+}
+
+void KineticEngine_predict(KineticEngine* engine, const PairList* pairList,
+                           Line** lines, double timeStep, uint64_t frame) {
+  for (size_t t = 0; t < engine->numTouched; t++) {
+    size_t i = engine->touchedLines[t];
+    KineticEngine_advance(engine, lines, i, timeStep, frame);
+    update_box(lines[i], timeStep);
+  }
+  for (size_t t = 0; t < engine->numTouched; t++) {
+    size_t i = engine->touchedLines[t];
+    Line* line = lines[i];
+    for (size_t n = engine->neighborStart[i];
+         n < engine->neighborStart[i + 1]; n++) {
+      size_t j = engine->neighbors[n];
+      // A pair of two touched lines is scheduled by the one with the lower
+      // index.
+      if (engine->touched[j]) {
+        if (j < i) continue;
+      } else {
+        KineticEngine_advance(engine, lines, j, timeStep, frame);
+        update_box(lines[j], timeStep);
+      }
+      uint64_t wake = frame + framesBeforeOverlap(line, lines[j], timeStep);
+      if (compareLines(line, lines[j]) < 0) {
+        schedulePair(engine, i, j, wake);
+      } else {
+        schedulePair(engine, j, i, wake);
+      }
+    }
+    scheduleLine(engine, &engine->wallQueue, i,
+                 frame + framesBeforeWall(line, timeStep));
+    scheduleLine(engine, &engine->escapeQueue, i,
+                 frame + framesBeforeEscape(pairList, i, line, timeStep));
+  }
+  for (size_t t = 0; t < engine->numTouched; t++) {
+    engine->touched[engine->touchedLines[t]] = false;
+  }
+  engine->numTouched = 0;
+
+  compactQueue(engine, &engine->pairQueue, engine->numNeighbors / 2, true);
+  compactQueue(engine, &engine->wallQueue, engine->numLines, false);
+  compactQueue(engine, &engine->escapeQueue, engine->numLines, false);
+}
+
+void KineticEngine_advance(KineticEngine* engine, Line** lines, size_t index,
+                           double timeStep, uint64_t frame) {
+  uint64_t from = engine->positionFrames[index];
+  assert(from <= frame);
+  if (from == frame) {
+    return;
+  }
+  Line* line = lines[index];
+  // The displacement is added once per frame, since adding a multiple of it
+  // would round differently.  Adding zero only changes anything the first
+  // time, when it turns a -0.0 into 0.0.
+  Vec displacement = Vec_multiply(line->velocity, timeStep);
+  if (displacement.x == 0 && displacement.y == 0) {
+    from = frame - 1;
+  }
+  for (uint64_t f = from; f < frame; f++) {
+    line->p1 = Vec_add(line->p1, displacement);
+    line->p2 = Vec_add(line->p2, displacement);
+  }
+  engine->positionFrames[index] = frame;
+}
+
+uint64_t KineticEngine_nextDueFrame(const KineticEngine* engine) {
+  const KineticQueue* queues[] = {
+    &engine->pairQueue, &engine->wallQueue, &engine->escapeQueue
+  };
+  uint64_t next = UINT64_MAX;
+  for (int q = 0; q < 3; q++) {
+    if (queues[q]->size > 0) {
+      next = min64(next, queues[q]->events[0].frame);
+    }
+  }
+  return next;
+}
+
+size_t KineticEngine_getNumQueued(const KineticEngine* engine) {
+  return engine->pairQueue.size + engine->wallQueue.size
+      + engine->escapeQueue.size;
+}
@@ -0,0 +1,189 @@
+/**
+ * Kinetic.h -- event-driven scheduling of pair tests and wall checks
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef KINETIC_H_
+#define KINETIC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./IntersectionEventList.h"
+#include "./Line.h"
+#include "./PairList.h"
+
+// The KineticEngine's PairList is grown by this many time steps of travel.
+// Pairs that are far apart cost little more than their queued events, so the
+// skin is much wider than with BROADPHASE_PAIR_LIST.
+#define KINETIC_SKIN_FRAMES 32
+
+// A pair test, wall check or grown-box check that is due at a frame.  It
+// only counts while the lines' stamps still match the ones it was
+// scheduled with.
+struct KineticEvent {
+  uint64_t frame;
+  size_t a, b;
+  uint64_t stampA, stampB;
+};
+typedef struct KineticEvent KineticEvent;
+
+// A binary min-heap of events by frame.
+struct KineticQueue {
+  KineticEvent* events;
+  size_t size;
+  size_t capacity;
+};
+typedef struct KineticQueue KineticQueue;
+
+// Schedules the work of a frame from the lines' current velocities instead of
+// redoing it every frame.  For each candidate pair of a PairList, it keeps
+// the earliest frame at which the pair's swept boxes could overlap, and for
+// each line the earliest frame at which it could hit a wall or leave its
+// grown box.  The predictions are conservative, so a frame tests every pair
+// and checks every line it would otherwise, and finds the same events.
+//
+// A line whose velocity changes is touched: its stamp is bumped, which
+// invalidates its queued events, and its events are predicted again.
+//
+// Lines are only moved when the engine needs their positions: each one is
+// left where it was at the start of its positionFrame, and brought forward
+// by KineticEngine_advance.
+//
+// An event that cannot be queued for lack of memory leaves built false: the
+// frame's events are still found, and the next frame rebuilds the engine.
+struct KineticEngine {
+  KineticQueue pairQueue;
+  KineticQueue wallQueue;
+  KineticQueue escapeQueue;
+
+  // Per line: the stamp, whether it was touched in the current frame, and
+  // its neighbors in the candidate pairs (CSR, neighborStart has numLines + 1
+  // entries).
+  uint64_t* stamps;
+  bool* touched;
+  size_t* touchedLines;
+  size_t numTouched;
+  size_t* neighborStart;
+  size_t* neighbors;
+  size_t numNeighbors;
+
+  // Lines stored by KineticEngine_popDueWalls.
+  size_t* dueWalls;
+
+  // Per line: the frame whose start its position is at.
+  uint64_t* positionFrames;
+
+  size_t numLines;
+  size_t capacity;
+  bool built;
+};
+typedef struct KineticEngine KineticEngine;
+
+// Returns an engine for up to capacity lines, which has to be rebuilt before
+// use, or NULL if it cannot be allocated.
+KineticEngine* KineticEngine_new(size_t capacity);
+
+// Does nothing if engine is NULL.
+void KineticEngine_delete(KineticEngine* engine);
+
+// Checks the grown-box events due at frame.  Returns whether the engine must
+// be rebuilt before testing the frame's pairs: it never was, an event could
+// not be queued, the number of lines changed, or a line left its grown box
+// in the PairList.
+bool KineticEngine_checkEscapes(KineticEngine* engine,
+                                const PairList* pairList, Line** lines,
+                                size_t numLines, double timeStep,
+                                uint64_t frame);
+
+// Predicts every event from frame on, given the candidate pairs of pairList,
+// which was just built from the first numLines of lines at their positions
+// at the start of frame.  Returns false, leaving the engine unbuilt, if
+// memory runs out.
+bool KineticEngine_rebuild(KineticEngine* engine, const PairList* pairList,
+                           Line** lines, size_t numLines,
+                           double timeStep, uint64_t frame);
+
+// Predicts the events from frame on of the lines [engine->numLines,
+// numLines), which were appended to pairList by PairList_extend along with
+// its pairs from firstPair on, and whose positionFrames are frame.  The
+// predictions of the other lines are kept.  Leaves the engine unbuilt if
+// memory runs out.
+void KineticEngine_extend(KineticEngine* engine, const PairList* pairList,
+                          Line** lines, size_t numLines,
+                          size_t firstPair, double timeStep,
+                          uint64_t frame);
+
+// Removes line i, into whose slot the line at last was just moved, after
+// PairList_removeLine took them out of pairList: the events of line i are
+// dropped and those of the moved line follow it to slot i.  An engine that
+// does not cover the same lines as pairList is left to be rebuilt.
+void KineticEngine_removeLine(KineticEngine* engine, const PairList* pairList,
+                              size_t i, size_t last);
+
+// Makes room for up to capacity lines.  Returns false, leaving the capacity
+// unchanged, if the memory cannot be allocated.
+bool KineticEngine_grow(KineticEngine* engine, size_t capacity);
+
+// Tests the pairs due at frame with intersect, appends their intersections
+// to intersectionEventList and schedules them again.  Returns the number of
+// pairs tested, and adds the number rejected by the box test to
+// *numBoxRejections.
+unsigned long long KineticEngine_testDuePairs(
+    KineticEngine* engine, Line** lines, double timeStep, uint64_t frame,
+    IntersectionEventList* intersectionEventList,
+    unsigned long long* numBoxRejections);
+
+// Records that the velocity of line index changed in the current frame.
+void KineticEngine_touch(KineticEngine* engine, size_t index);
+
+// Stores in dueWalls the lines whose walls must be checked after frame's
+// position update: every touched line and every line with a wall event due.
+// Returns the number of lines stored.
+size_t KineticEngine_popDueWalls(KineticEngine* engine, uint64_t frame);
+
+// Schedules the next wall event of line index, whose wall check at frame
+// found no collision.  Touched lines are left to KineticEngine_predict.
+void KineticEngine_keepWall(KineticEngine* engine, Line** lines,
+                            size_t index, double timeStep,
+                            uint64_t frame);
+
+// Predicts again the events of the lines touched in the frame before frame,
+// from their positions at the start of frame, to which they and their
+// neighbors are advanced.
+void KineticEngine_predict(KineticEngine* engine, const PairList* pairList,
+                           Line** lines, double timeStep, uint64_t frame);
+
+// Moves line index from its position at the start of its positionFrame to
+// its position at the start of frame, bit for bit as that many position
+// updates would.
+void KineticEngine_advance(KineticEngine* engine, Line** lines, size_t index,
+                           double timeStep, uint64_t frame);
+
+// Returns the earliest frame any event is queued for, or UINT64_MAX if the
+// queues are empty.  No frame before it has pairs to test or walls to check.
+uint64_t KineticEngine_nextDueFrame(const KineticEngine* engine);
+
+// Number of events queued, counting invalidated ones.
+size_t KineticEngine_getNumQueued(const KineticEngine* engine);
+
+#endif  // KINETIC_H_
@@ -24,7 +24,9 @@
 #ifndef LINE_H_
 #define LINE_H_
 
-#include "./GraphicStuff.h"
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "./Vec.h"
 
 // Lines' coordinates are stored in a box with these bounds
@@ -54,18 +56,23 @@ struct Line {
   Vec p1;  // One endpoint of the line.
   Vec p2;  // The other endpoint of the line.
 
-  bool max_x_is_p1, max_y_is_p1;
   double u_x, l_x, u_y, l_y;
 
   // The line's current velocity, in units of pixels per time step.
   Vec velocity;
 
+  uint64_t id;  // Unique line ID.
+
   Color color;  // The line's color.
 
-  unsigned int id;  // Unique line ID.
+  bool max_x_is_p1, max_y_is_p1;
 };
 typedef struct Line Line;
 
+// Every frame streams over all the lines, so the 64-bit ID is packed in
+// without making them larger.
+_Static_assert(sizeof(Line) == 96, "Line grew past 96 bytes");
+
 // Compares the lines by line ID.
 // -1 <=> line1 ordered before line2
 //  0 <=> line1 ordered the same as line2
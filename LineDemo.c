@@ -25,10 +25,13 @@
 
 #include <time.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <assert.h>
 #include <stdio.h>
 
 #include "./GraphicStuff.h"
+#include "./ktiming.h"
 #include "./Line.h"
 
 LineDemo* LineDemo_new() {
@@ -38,20 +41,58 @@ LineDemo* LineDemo_new() {
   }
 
   lineDemo->count = 0;
+  lineDemo->firstFrame = 0;
   lineDemo->numFrames = 0;
   lineDemo->collisionWorld = NULL;
+  lineDemo->inputFile = "line.in";
+  lineDemo->checkpointFile = NULL;
+  lineDemo->frameTimes = NULL;
+  lineDemo->numFrameTimes = 0;
+  lineDemo->frameDeadline = 0;
+  lineDemo->numMissedDeadlines = 0;
+  lineDemo->printStats = false;
+  lineDemo->eventLog = NULL;
+  lineDemo->replayLog = NULL;
+  lineDemo->hashFile = NULL;
+  lineDemo->checkHashes = false;
+  lineDemo->firstDivergentFrame = 0;
+  lineDemo->numDivergentFrames = 0;
   return lineDemo;
 }
 
 void LineDemo_delete(LineDemo* lineDemo) {
   CollisionWorld_delete(lineDemo->collisionWorld);
+  free(lineDemo->frameTimes);
+  if (lineDemo->hashFile != NULL) {
+    fclose(lineDemo->hashFile);
+  }
+  if (lineDemo->eventLog != NULL) {
+    EventLog_close(lineDemo->eventLog);
+  }
+  if (lineDemo->replayLog != NULL) {
+    EventLog_close(lineDemo->replayLog);
+  }
   free(lineDemo);
 }
 
-// Read in lines from line.in and add them into collision world for simulation.
+void LineDemo_setInputFile(LineDemo* lineDemo, const char* inputFile) {
+  lineDemo->inputFile = inputFile;
+}
+
+void LineDemo_setCheckpointFile(LineDemo* lineDemo,
+                                const char* checkpointFile) {
+  lineDemo->checkpointFile = checkpointFile;
+}
+
+bool LineDemo_saveCheckpoint(LineDemo* lineDemo, const char* path) {
+  return CollisionWorld_saveCheckpoint(lineDemo->collisionWorld, path);
+}
+
+// Read in lines from the input file and add them into collision world for
+// simulation.
 void LineDemo_createLines(LineDemo* lineDemo) {
-  unsigned int lineId = 0;
-  unsigned int numOfLines;
+  uint64_t lineId = 0;
+  uint64_t numOfLines;
   window_dimension px1;
   window_dimension py1;
   window_dimension px2;
@@ -60,16 +101,34 @@ void LineDemo_createLines(LineDemo* lineDemo) {
   window_dimension vy;
   int isGray;
   FILE *fin;
-  fin = fopen("line.in", "r");
-  assert(fin != NULL);
+  fin = fopen(lineDemo->inputFile, "r");
+  if (fin == NULL) {
+    perror(lineDemo->inputFile);
+    exit(1);
+  }
 
-  fscanf(fin, "%d\n", &numOfLines);
+  if (fscanf(fin, "%" SCNu64 "\n", &numOfLines) != 1
+      || numOfLines > SIZE_MAX / sizeof(Line)) {
+    fprintf(stderr, "%s: missing or out-of-range line count\n",
+            lineDemo->inputFile);
+    exit(1);
+  }
   lineDemo->collisionWorld = CollisionWorld_new(numOfLines);
+  if (lineDemo->collisionWorld == NULL) {
+    fprintf(stderr, "%s: no memory for %" PRIu64 " lines\n",
+            lineDemo->inputFile, numOfLines);
+    exit(1);
+  }
 
   while (EOF
       != fscanf(fin, "(%lf, %lf), (%lf, %lf), %lf, %lf, %d\n", &px1, &py1, &px2,
                 &py2, &vx, &vy, &isGray)) {
     Line *line = malloc(sizeof(Line));
+    if (line == NULL) {
+      fprintf(stderr, "%s: no memory for line %" PRIu64 "\n",
+              lineDemo->inputFile, lineId);
+      exit(1);
+    }
 
     // convert window coordinates to box coordinates
     windowToBox(&line->p1.x, &line->p1.y, px1, py1);
@@ -90,40 +149,269 @@ void LineDemo_createLines(LineDemo* lineDemo) {
     lineId++;
 
     // transfer ownership of line to collisionWorld
-    CollisionWorld_addLine(lineDemo->collisionWorld, line);
+    if (!CollisionWorld_addLine(lineDemo->collisionWorld, line)) {
+      fprintf(stderr, "%s: no memory for line %" PRIu64 "\n",
+              lineDemo->inputFile, line->id);
+      exit(1);
+    }
   }
   fclose(fin);
 }
 
-void LineDemo_setNumFrames(LineDemo* lineDemo, const unsigned int numFrames) {
+void LineDemo_setNumFrames(LineDemo* lineDemo, const uint64_t numFrames) {
   lineDemo->numFrames = numFrames;
+
+  // LineDemo_update simulates one frame past numFrames before stopping.
+  // Without room for the durations, the frame latency is not reported.
+  free(lineDemo->frameTimes);
+  lineDemo->frameTimes = (numFrames < SIZE_MAX / sizeof(uint64_t))
+      ? malloc((numFrames + 1) * sizeof(uint64_t)) : NULL;
+  lineDemo->numFrameTimes = 0;
+}
+
+void LineDemo_setFrameDeadline(LineDemo* lineDemo, const uint64_t deadline) {
+  lineDemo->frameDeadline = deadline;
+}
+
+uint64_t LineDemo_getNumMissedDeadlines(LineDemo* lineDemo) {
+  return lineDemo->numMissedDeadlines;
+}
+
+void LineDemo_setPrintStats(LineDemo* lineDemo, const bool printStats) {
+  lineDemo->printStats = printStats;
+  CollisionWorld_setCollectStats(lineDemo->collisionWorld, printStats);
+}
+
+bool LineDemo_writeStateHashes(LineDemo* lineDemo, const char* path) {
+  lineDemo->hashFile = fopen(path, "w");
+  lineDemo->checkHashes = false;
+  return lineDemo->hashFile != NULL;
+}
+
+bool LineDemo_checkStateHashes(LineDemo* lineDemo, const char* path) {
+  lineDemo->hashFile = fopen(path, "r");
+  lineDemo->checkHashes = true;
+  return lineDemo->hashFile != NULL;
+}
+
+bool LineDemo_writeEventLog(LineDemo* lineDemo, const char* path) {
+  CollisionWorld* collisionWorld = lineDemo->collisionWorld;
+  lineDemo->eventLog = EventLog_create(path, collisionWorld->numOfLines,
+                                       collisionWorld->frameCount);
+  if (lineDemo->eventLog == NULL) {
+    return false;
+  }
+  CollisionWorld_setEventLog(collisionWorld, lineDemo->eventLog);
+  return true;
+}
+
+bool LineDemo_replayEventLog(LineDemo* lineDemo, const char* path) {
+  lineDemo->replayLog = EventLog_open(path);
+  return lineDemo->replayLog != NULL
+      && CollisionWorld_setReplay(lineDemo->collisionWorld,
+                                  lineDemo->replayLog);
+}
+
+uint64_t LineDemo_getFirstDivergentFrame(LineDemo* lineDemo) {
+  return lineDemo->firstDivergentFrame;
+}
+
+uint64_t LineDemo_getNumDivergentFrames(LineDemo* lineDemo) {
+  return lineDemo->numDivergentFrames;
+}
+
+// Writes or checks the hash of the frame that was just simulated.  The file
+// holds one "<frame> <hash>" line per frame.
+static void recordStateHash(LineDemo* lineDemo) {
+  uint64_t hash = CollisionWorld_hashState(lineDemo->collisionWorld);
+  if (!lineDemo->checkHashes) {
+    fprintf(lineDemo->hashFile, "%" PRIu64 " %016" PRIx64 "\n",
+            lineDemo->count, hash);
+    return;
+  }
+
+  // A run resumed from a checkpoint skips the frames before it.
+  uint64_t frame;
+  uint64_t expected;
+  int numRead;
+  do {
+    numRead = fscanf(lineDemo->hashFile, "%" SCNu64 " %" SCNx64, &frame,
+                     &expected);
+  } while (numRead == 2 && frame < lineDemo->count);
+  if (numRead != 2 || frame != lineDemo->count) {
+    if (lineDemo->firstDivergentFrame == 0) {
+      fprintf(stderr, "Frame %" PRIu64 ": no reference state hash\n",
+              lineDemo->count);
+      lineDemo->firstDivergentFrame = lineDemo->count;
+    }
+    lineDemo->numDivergentFrames++;
+    return;
+  }
+  if (hash != expected) {
+    if (lineDemo->firstDivergentFrame == 0) {
+      fprintf(stderr, "Frame %" PRIu64 ": state hash %016" PRIx64
+              " differs from reference %016" PRIx64 "\n", lineDemo->count,
+              hash, expected);
+      lineDemo->firstDivergentFrame = lineDemo->count;
+    }
+    lineDemo->numDivergentFrames++;
+  }
+}
+
+static void printFrameStats(LineDemo* lineDemo) {
+  const CollisionWorldFrameStats* stats =
+      CollisionWorld_getFrameStats(lineDemo->collisionWorld);
+  double hitRate = (stats->numIntersectCalls > 0)
+      ? 100.0 * stats->numEvents / stats->numIntersectCalls : 0.0;
+  double rejectRate = (stats->numIntersectCalls > 0)
+      ? 100.0 * stats->numBoxRejections / stats->numIntersectCalls : 0.0;
+
+  if (CollisionWorld_isKinetic(lineDemo->collisionWorld)) {
+    printf("Frame %" PRIu64 ": %zu candidate pairs, list %s, %" PRIu64
+           " builds so far, %llu events queued\n", lineDemo->count,
+           stats->numCandidatePairs,
+           stats->pairListRebuilt ? "rebuilt" : "reused",
+           stats->numPairListBuilds, stats->numQueuedEvents);
+  } else if (CollisionWorld_getBroadphase(lineDemo->collisionWorld)
+             == BROADPHASE_PAIR_LIST) {
+    printf("Frame %" PRIu64 ": %zu candidate pairs, list %s, %" PRIu64
+           " builds so far\n",
+           lineDemo->count, stats->numCandidatePairs,
+           stats->pairListRebuilt ? "rebuilt" : "reused",
+           stats->numPairListBuilds);
+  } else {
+    printf("Frame %" PRIu64 ": %zu nodes, depth max %u mean %.2f, %zu leaves "
+           "with occupancy mean %.2f max %.2f of N\n", lineDemo->count,
+           stats->numTreeNodes, stats->maxTreeDepth, stats->meanLeafDepth,
+           stats->numLeaves, stats->meanLeafOccupancy,
+           stats->maxLeafOccupancy);
+    if (stats->numStaticLines > 0) {
+      printf("  %zu static lines, index built %" PRIu64 " times so far\n",
+             stats->numStaticLines, stats->numStaticIndexBuilds);
+    }
+  }
+  printf("  %llu intersect calls, %llu box rejections (%.2f%%), "
+         "%zu events (hit rate %.4f%%)\n", stats->numIntersectCalls,
+         stats->numBoxRejections, rejectRate, stats->numEvents, hitRate);
+  if (stats->linesReordered) {
+    printf("  lines re-sorted along the Hilbert curve, %" PRIu64
+           " times so far\n",
+           stats->numReorders);
+  }
+  for (int level = 0; level < STATS_MAX_LEVELS; level++) {
+    if (stats->numNodes[level] == 0) {
+      continue;
+    }
+    printf("  level %d: %zu nodes, %zu straddlers, upstream mean %.1f "
+           "max %zu\n",
+           level, stats->numNodes[level], stats->numStraddlers[level],
+           (double) stats->totalUpstream[level] / stats->numNodes[level],
+           stats->maxUpstream[level]);
+  }
+}
+
+static int compareFrameTimes(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of the sorted samples.
+static uint64_t percentile(const uint64_t* sorted, size_t n, double p) {
+  size_t rank = (size_t) ((p / 100.0) * n + 0.999999);
+  if (rank < 1) rank = 1;
+  if (rank > n) rank = n;
+  return sorted[rank - 1];
+}
+
+void LineDemo_printFrameLatency(LineDemo* lineDemo, FILE* out) {
+  size_t n = lineDemo->numFrameTimes;
+  if (n == 0) {
+    return;
+  }
+  uint64_t* sorted = malloc(n * sizeof(uint64_t));
+  if (sorted == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < n; i++) {
+    sorted[i] = lineDemo->frameTimes[i];
+  }
+  qsort(sorted, n, sizeof(uint64_t), compareFrameTimes);
+
+  fprintf(out, "---- FRAME LATENCY (%zu frames, ms) ----\n", n);
+  fprintf(out, "min %.3f  p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+          sorted[0] / 1e6, percentile(sorted, n, 50.0) / 1e6,
+          percentile(sorted, n, 90.0) / 1e6, percentile(sorted, n, 99.0) / 1e6,
+          percentile(sorted, n, 99.9) / 1e6, sorted[n - 1] / 1e6);
+  if (lineDemo->frameDeadline > 0) {
+    fprintf(out, "%" PRIu64 " frames missed the %.3f ms deadline\n",
+            lineDemo->numMissedDeadlines, lineDemo->frameDeadline / 1e6);
+  }
+  fprintf(out, "---- END FRAME LATENCY ----\n");
+  free(sorted);
 }
 
 void LineDemo_initLine(LineDemo* lineDemo) {
-  LineDemo_createLines(lineDemo);
+  if (lineDemo->checkpointFile == NULL) {
+    LineDemo_createLines(lineDemo);
+    return;
+  }
+  lineDemo->collisionWorld =
+      CollisionWorld_newFromCheckpoint(lineDemo->checkpointFile);
+  if (lineDemo->collisionWorld == NULL) {
+    fprintf(stderr, "%s: unreadable or not a checkpoint of this build\n",
+            lineDemo->checkpointFile);
+    exit(1);
+  }
+  lineDemo->count = lineDemo->collisionWorld->frameCount;
+  lineDemo->firstFrame = lineDemo->count;
 }
 
-Line* LineDemo_getLine(LineDemo* lineDemo, const unsigned int index) {
+Line* LineDemo_getLine(LineDemo* lineDemo, const size_t index) {
   return CollisionWorld_getLine(lineDemo->collisionWorld, index);
 }
 
-unsigned int LineDemo_getNumOfLines(LineDemo* lineDemo) {
+size_t LineDemo_getNumOfLines(LineDemo* lineDemo) {
   return CollisionWorld_getNumOfLines(lineDemo->collisionWorld);
 }
 
-unsigned int LineDemo_getNumLineWallCollisions(LineDemo* lineDemo) {
+uint64_t LineDemo_getNumLineWallCollisions(LineDemo* lineDemo) {
   return CollisionWorld_getNumLineWallCollisions(lineDemo->collisionWorld);
 }
 
-unsigned int LineDemo_getNumLineLineCollisions(LineDemo* lineDemo) {
+uint64_t LineDemo_getNumLineLineCollisions(LineDemo* lineDemo) {
   return CollisionWorld_getNumLineLineCollisions(lineDemo->collisionWorld);
 }
 
 // The main simulation loop
 bool LineDemo_update(LineDemo* lineDemo) {
   lineDemo->count++;
+  const clockmark_t start = ktiming_getmark();
   CollisionWorld_updateLines(lineDemo->collisionWorld);
-  if (lineDemo->count > lineDemo->numFrames) {
+  const clockmark_t end = ktiming_getmark();
+
+  uint64_t frameTime = ktiming_diff_usec(&start, &end);
+  if (lineDemo->frameTimes != NULL
+      && lineDemo->numFrameTimes <= lineDemo->numFrames) {
+    lineDemo->frameTimes[lineDemo->numFrameTimes++] = frameTime;
+  }
+  if (lineDemo->frameDeadline > 0 && frameTime > lineDemo->frameDeadline) {
+    const CollisionWorldFrameStats* stats =
+        CollisionWorld_getFrameStats(lineDemo->collisionWorld);
+    lineDemo->numMissedDeadlines++;
+    fprintf(stderr, "Frame %" PRIu64 " missed deadline: %.3f ms, %zu events, "
+            "%zu tree nodes, tree depth %u\n", lineDemo->count,
+            frameTime / 1e6, stats->numEvents, stats->numTreeNodes,
+            stats->maxTreeDepth);
+  }
+  if (lineDemo->printStats) {
+    printFrameStats(lineDemo);
+  }
+  if (lineDemo->hashFile != NULL) {
+    recordStateHash(lineDemo);
+  }
+
+  if (lineDemo->count - lineDemo->firstFrame > lineDemo->numFrames) {
     return false;
   }
   return true;
@@ -24,44 +24,132 @@
 #ifndef LINEDEMO_H_
 #define LINEDEMO_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
 #include "./Line.h"
 #include "./CollisionWorld.h"
 
 struct LineDemo {
-  // Iteration counter
-  unsigned int count;
+  // Iteration counter, and its value when the simulation started, which is
+  // not 0 when it resumed from a checkpoint
+  uint64_t count;
+  uint64_t firstFrame;
 
   // Number of frames to compute
-  unsigned int numFrames;
+  uint64_t numFrames;
 
   // Objects for line simulation
   CollisionWorld* collisionWorld;
+
+  // File the lines are read from, and the checkpoint to resume from instead
+  // if not NULL
+  const char* inputFile;
+  const char* checkpointFile;
+
+  // Duration of each simulated frame, in nanoseconds
+  uint64_t* frameTimes;
+  size_t numFrameTimes;
+
+  // Per-frame deadline in nanoseconds (0 if disabled), and the number of
+  // frames that missed it
+  uint64_t frameDeadline;
+  uint64_t numMissedDeadlines;
+
+  // Whether to print the quadtree and pair-test statistics of every frame
+  bool printStats;
+
+  // Event logs written and replayed, or NULL
+  EventLog* eventLog;
+  EventLog* replayLog;
+
+  // File of per-frame state hashes that are either written or checked
+  FILE* hashFile;
+  bool checkHashes;
+  // First frame whose hash differed from the file (0 if none), and the
+  // number of frames that differed
+  uint64_t firstDivergentFrame;
+  uint64_t numDivergentFrames;
 };
 typedef struct LineDemo LineDemo;
 
 LineDemo* LineDemo_new();
 void LineDemo_delete(LineDemo* lineDemo);
 
-// Add lines for line simulation at beginning.
+// Set the file to read lines from (line.in by default).
+void LineDemo_setInputFile(LineDemo* lineDemo, const char* inputFile);
+
+// Resume from a checkpoint written by LineDemo_saveCheckpoint instead of
+// reading lines from the input file.
+void LineDemo_setCheckpointFile(LineDemo* lineDemo, const char* checkpointFile);
+
+// Write a checkpoint of the simulation, from which a later run can resume.
+// Returns false if the file cannot be written.
+bool LineDemo_saveCheckpoint(LineDemo* lineDemo, const char* path);
+
+// Add lines for line simulation at beginning.  Exits if the input file cannot
+// be read or holds more lines than fit in memory.
 void LineDemo_createLines(LineDemo* lineDemo);
 
-// Set number of frames to compute.
-void LineDemo_setNumFrames(LineDemo* lineDemo, const unsigned int numFrames);
+// Set number of frames to compute, counted from the first frame after the
+// checkpoint when resuming from one.
+void LineDemo_setNumFrames(LineDemo* lineDemo, const uint64_t numFrames);
 
-// Initialize line simulation.
+// Initialize line simulation.  Exits if the checkpoint cannot be read.
 void LineDemo_initLine(LineDemo* lineDemo);
 
 // Get ith line.
-Line* LineDemo_getLine(LineDemo* lineDemo, const unsigned int index);
+Line* LineDemo_getLine(LineDemo* lineDemo, const size_t index);
 
 // Get num of lines.
-unsigned int LineDemo_getNumOfLines(LineDemo* lineDemo);
+size_t LineDemo_getNumOfLines(LineDemo* lineDemo);
 
 // Get number of line-wall collisions.
-unsigned int LineDemo_getNumLineWallCollisions(LineDemo* lineDemo);
+uint64_t LineDemo_getNumLineWallCollisions(LineDemo* lineDemo);
 
 // Get number of line-line collisions.
-unsigned int LineDemo_getNumLineLineCollisions(LineDemo* lineDemo);
+uint64_t LineDemo_getNumLineLineCollisions(LineDemo* lineDemo);
+
+// Set a per-frame deadline in nanoseconds.  Every frame that takes longer
+// is counted and logged to stderr.  0 disables the deadline.
+void LineDemo_setFrameDeadline(LineDemo* lineDemo, const uint64_t deadline);
+
+// Get number of frames that missed the deadline.
+uint64_t LineDemo_getNumMissedDeadlines(LineDemo* lineDemo);
+
+// Collect the quadtree and pair-test statistics of every frame and print
+// them to stdout.  Must be called after LineDemo_initLine.
+void LineDemo_setPrintStats(LineDemo* lineDemo, const bool printStats);
+
+// Write the state hash of every frame to the file.  Returns false if the file
+// cannot be opened.
+bool LineDemo_writeStateHashes(LineDemo* lineDemo, const char* path);
+
+// Check the state hash of every frame against a file written by
+// LineDemo_writeStateHashes, for example by a run with a single worker.  The
+// first frame that diverges is reported on stderr.  Returns false if the file
+// cannot be opened.
+bool LineDemo_checkStateHashes(LineDemo* lineDemo, const char* path);
+
+// Write every frame's sorted events to an event log.  Must be called after
+// LineDemo_initLine.  Returns false if the file cannot be created.
+bool LineDemo_writeEventLog(LineDemo* lineDemo, const char* path);
+
+// Replay the events of a log written by LineDemo_writeEventLog instead of
+// detecting them, until it runs out.  Must be called after LineDemo_initLine.
+// Returns false if the file cannot be opened or the log does not start at the
+// next frame of the same lines.
+bool LineDemo_replayEventLog(LineDemo* lineDemo, const char* path);
+
+// Get the first frame whose state hash diverged (0 if none).
+uint64_t LineDemo_getFirstDivergentFrame(LineDemo* lineDemo);
+
+// Get the number of frames whose state hash diverged.
+uint64_t LineDemo_getNumDivergentFrames(LineDemo* lineDemo);
+
+// Print the min, p50, p90, p99, p99.9 and max frame durations.
+void LineDemo_printFrameLatency(LineDemo* lineDemo, FILE* out);
 
 // Line simulation update function.
 bool LineDemo_update(LineDemo* lineDemo);
@@ -0,0 +1,149 @@
+/**
+ * LineTable.c -- map from line IDs to storage slots
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./LineTable.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+// Smallest number of entries of a table.
+#define LINE_TABLE_MIN_SIZE 16
+
+static inline size_t hashId(uint64_t id, size_t size) {
+  uint64_t hash = id * 0x9e3779b97f4a7c15ULL;
+  return (size_t) (hash ^ (hash >> 32)) & (size - 1);
+}
+
+// Returns size free entries, or NULL if they cannot be allocated.
+static LineTableEntry* newEntries(size_t size) {
+  LineTableEntry* entries = malloc(size * sizeof(LineTableEntry));
+  if (entries == NULL) {
+    return NULL;
+  }
+  for (size_t e = 0; e < size; e++) {
+    entries[e].slot = LINE_TABLE_NONE;
+  }
+  return entries;
+}
+
+LineTable* LineTable_new(size_t capacity) {
+  LineTable* table = malloc(sizeof(LineTable));
+  if (table == NULL) {
+    return NULL;
+  }
+  size_t size = LINE_TABLE_MIN_SIZE;
+  while (size < 2 * capacity) {
+    size *= 2;
+  }
+  table->entries = newEntries(size);
+  if (table->entries == NULL) {
+    free(table);
+    return NULL;
+  }
+  table->numEntries = 0;
+  table->size = size;
+  return table;
+}
+
+void LineTable_delete(LineTable* table) {
+  if (table == NULL) {
+    return;
+  }
+  free(table->entries);
+  free(table);
+}
+
+// Returns the entry holding the ID, or the free entry where it would go.
+static inline LineTableEntry* probe(const LineTable* table, uint64_t id) {
+  size_t e = hashId(id, table->size);
+  while (table->entries[e].slot != LINE_TABLE_NONE
+         && table->entries[e].id != id) {
+    e = (e + 1) & (table->size - 1);
+  }
+  return &table->entries[e];
+}
+
+size_t LineTable_find(const LineTable* table, uint64_t id) {
+  return probe(table, id)->slot;
+}
+
+// Doubles the number of entries and inserts the IDs again.  Returns false,
+// leaving the table unchanged, if the entries cannot be allocated.
+static bool grow(LineTable* table) {
+  LineTableEntry* entries = newEntries(2 * table->size);
+  if (entries == NULL) {
+    return false;
+  }
+  LineTableEntry* old = table->entries;
+  size_t oldSize = table->size;
+  table->size = 2 * oldSize;
+  table->entries = entries;
+  for (size_t e = 0; e < oldSize; e++) {
+    if (old[e].slot != LINE_TABLE_NONE) {
+      *probe(table, old[e].id) = old[e];
+    }
+  }
+  free(old);
+  return true;
+}
+
+bool LineTable_set(LineTable* table, uint64_t id, size_t slot) {
+  assert(slot != LINE_TABLE_NONE);
+  LineTableEntry* entry = probe(table, id);
+  if (entry->slot == LINE_TABLE_NONE) {
+    if (2 * (table->numEntries + 1) > table->size) {
+      if (!grow(table)) {
+        return false;
+      }
+      entry = probe(table, id);
+    }
+    table->numEntries++;
+    entry->id = id;
+  }
+  entry->slot = slot;
+  return true;
+}
+
+bool LineTable_remove(LineTable* table, uint64_t id) {
+  LineTableEntry* entry = probe(table, id);
+  if (entry->slot == LINE_TABLE_NONE) {
+    return false;
+  }
+  entry->slot = LINE_TABLE_NONE;
+  table->numEntries--;
+
+  // Shift back the entries after the hole that probe would no longer reach:
+  // those whose home entry is not cyclically between the hole and them.
+  size_t mask = table->size - 1;
+  size_t hole = entry - table->entries;
+  for (size_t e = (hole + 1) & mask; table->entries[e].slot
+       != LINE_TABLE_NONE; e = (e + 1) & mask) {
+    size_t home = hashId(table->entries[e].id, table->size);
+    if (((e - home) & mask) >= ((e - hole) & mask)) {
+      table->entries[hole] = table->entries[e];
+      table->entries[e].slot = LINE_TABLE_NONE;
+      hole = e;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,71 @@
+/**
+ * LineTable.h -- map from line IDs to storage slots
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef LINETABLE_H_
+#define LINETABLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Returned by LineTable_find for an ID that is not in the table.
+#define LINE_TABLE_NONE SIZE_MAX
+
+// An entry of the table.  Free entries have slot LINE_TABLE_NONE.
+struct LineTableEntry {
+  uint64_t id;
+  size_t slot;
+};
+typedef struct LineTableEntry LineTableEntry;
+
+// An open-addressing hash table from the ID of every line in a
+// CollisionWorld to the slot of the world's storage it is in.  Line IDs are
+// the stable handles of the lines: a slot changes when another line is
+// removed, an ID never does.  The table is kept at most half full, so a
+// lookup probes a couple of entries.
+struct LineTable {
+  LineTableEntry* entries;
+  size_t numEntries;
+  size_t size;
+};
+typedef struct LineTable LineTable;
+
+// Returns an empty table with room for about capacity IDs before it grows,
+// or NULL if it cannot be allocated.
+LineTable* LineTable_new(size_t capacity);
+
+// Does nothing if table is NULL.
+void LineTable_delete(LineTable* table);
+
+// Returns the slot of the ID, or LINE_TABLE_NONE.
+size_t LineTable_find(const LineTable* table, uint64_t id);
+
+// Maps the ID to slot, replacing the slot it was mapped to, if any.  Returns
+// false, leaving the table unchanged, if a new ID does not fit and the table
+// cannot grow.  Remapping an ID already in the table always succeeds.
+bool LineTable_set(LineTable* table, uint64_t id, size_t slot);
+
+// Removes the ID.  Returns false if it was not in the table.
+bool LineTable_remove(LineTable* table, uint64_t id);
+
+#endif  // LINETABLE_H_
@@ -0,0 +1,379 @@
+/**
+ * PairList.c -- candidate pairs of lines reused across frames
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./PairList.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./Parallel.h"
+
+// The sweep hands out this many lines, in x order, to each task.
+#define SWEEP_CHUNK 64
+
+// PairList_extend hands out this many of the earlier lines to each task.
+#define EXTEND_CHUNK 4096
+
+// A line in the sweep order.
+struct SweepEntry {
+  double l_x;
+  size_t index;
+};
+typedef struct SweepEntry SweepEntry;
+
+// Pairs found by one task of the sweep, and whether some of them could not
+// be stored.
+struct SweepChunk {
+  LinePair* pairs;
+  size_t numPairs;
+  size_t capacity;
+  bool failed;
+};
+typedef struct SweepChunk SweepChunk;
+
+struct SweepArgs {
+  PairList* pairList;
+  Line** lines;
+  SweepEntry* order;
+  size_t numLines;
+  SweepChunk* chunks;
+};
+typedef struct SweepArgs SweepArgs;
+
+struct ExtendArgs {
+  PairList* pairList;
+  Line** lines;
+  size_t firstNew;
+  size_t numLines;
+  SweepChunk* chunks;
+};
+typedef struct ExtendArgs ExtendArgs;
+
+PairList* PairList_new(size_t capacity) {
+  PairList* pairList = malloc(sizeof(PairList));
+  if (pairList == NULL) {
+    return NULL;
+  }
+  pairList->pairs = NULL;
+  pairList->numPairs = 0;
+  pairList->pairCapacity = 0;
+  pairList->boxes = malloc(capacity * sizeof(PairListBox));
+  if (pairList->boxes == NULL) {
+    free(pairList);
+    return NULL;
+  }
+  pairList->numLines = 0;
+  pairList->capacity = capacity;
+  pairList->skin = 0;
+  pairList->age = 0;
+  pairList->numBuilds = 0;
+  pairList->valid = false;
+  return pairList;
+}
+
+void PairList_delete(PairList* pairList) {
+  if (pairList == NULL) {
+    return;
+  }
+  free(pairList->pairs);
+  free(pairList->boxes);
+  free(pairList);
+}
+
+bool PairList_isExpired(const PairList* pairList, size_t numLines) {
+  return !pairList->valid || pairList->numLines > numLines
+      || numLines - pairList->numLines > PAIR_LIST_MAX_EXTEND
+      || pairList->age >= PAIR_LIST_MAX_FRAMES;
+}
+
+static int compareSweepEntries(const void* a, const void* b) {
+  const SweepEntry* x = a;
+  const SweepEntry* y = b;
+  if (x->l_x != y->l_x) {
+    return (x->l_x > y->l_x) - (x->l_x < y->l_x);
+  }
+  return (x->index > y->index) - (x->index < y->index);
+}
+
+static void appendPair(SweepChunk* chunk, Line** lines, size_t i1,
+                       size_t i2) {
+  if (chunk->numPairs == chunk->capacity) {
+    size_t capacity = (chunk->capacity > 0) ? 2 * chunk->capacity : 256;
+    LinePair* pairs = realloc(chunk->pairs, capacity * sizeof(LinePair));
+    if (pairs == NULL) {
+      chunk->failed = true;
+      return;
+    }
+    chunk->pairs = pairs;
+    chunk->capacity = capacity;
+  }
+  if (compareLines(lines[i1], lines[i2]) >= 0) {
+    size_t temp = i1;
+    i1 = i2;
+    i2 = temp;
+  }
+  LinePair* pair = &chunk->pairs[chunk->numPairs++];
+  pair->l1 = lines[i1];
+  pair->l2 = lines[i2];
+  pair->i1 = i1;
+  pair->i2 = i2;
+}
+
+// Frees the pairs of the chunks.
+static void freeChunks(SweepChunk* chunks, size_t numChunks) {
+  for (size_t c = 0; c < numChunks; c++) {
+    free(chunks[c].pairs);
+  }
+}
+
+// Appends the pairs found by the chunks to the list, and frees them.
+// Returns false, appending none, if a chunk is missing pairs or the list
+// cannot grow.
+static bool appendChunks(PairList* pairList, SweepChunk* chunks,
+                         size_t numChunks) {
+  size_t numPairs = pairList->numPairs;
+  for (size_t c = 0; c < numChunks; c++) {
+    if (chunks[c].failed) {
+      freeChunks(chunks, numChunks);
+      return false;
+    }
+    numPairs += chunks[c].numPairs;
+  }
+  if (numPairs > pairList->pairCapacity) {
+    size_t capacity = 2 * pairList->pairCapacity;
+    if (capacity < numPairs) {
+      capacity = numPairs;
+    }
+    LinePair* pairs = realloc(pairList->pairs, capacity * sizeof(LinePair));
+    if (pairs == NULL) {
+      freeChunks(chunks, numChunks);
+      return false;
+    }
+    pairList->pairs = pairs;
+    pairList->pairCapacity = capacity;
+  }
+  for (size_t c = 0; c < numChunks; c++) {
+    if (chunks[c].numPairs > 0) {
+      memcpy(&pairList->pairs[pairList->numPairs], chunks[c].pairs,
+             chunks[c].numPairs * sizeof(LinePair));
+      pairList->numPairs += chunks[c].numPairs;
+    }
+    free(chunks[c].pairs);
+  }
+  return true;
+}
+
+// Pairs every line of the given chunks with the lines after it in x order
+// whose grown boxes overlap its own.
+static void sweepChunks(size_t begin, size_t end, void* arg) {
+  SweepArgs* args = arg;
+  const PairListBox* boxes = args->pairList->boxes;
+  for (size_t c = begin; c < end; c++) {
+    SweepChunk* chunk = &args->chunks[c];
+    size_t last = (c + 1) * SWEEP_CHUNK;
+    if (last > args->numLines) {
+      last = args->numLines;
+    }
+    for (size_t i = c * SWEEP_CHUNK; i < last; i++) {
+      const PairListBox* box = &boxes[args->order[i].index];
+      for (size_t j = i + 1; j < args->numLines; j++) {
+        if (args->order[j].l_x > box->u_x) {
+          break;
+        }
+        const PairListBox* other = &boxes[args->order[j].index];
+        if (box->l_y <= other->u_y && box->u_y >= other->l_y) {
+          appendPair(chunk, args->lines, args->order[i].index,
+                     args->order[j].index);
+        }
+      }
+    }
+  }
+}
+
+bool PairList_build(PairList* pairList, Line** lines, size_t numLines,
+                    double timeStep, unsigned int skinFrames) {
+  assert(numLines <= pairList->capacity);
+  pairList->valid = false;
+  pairList->numPairs = 0;
+
+  // Grow the boxes by the distance the fastest line covers in skinFrames time
+  // steps along either axis.
+  double maxSpeed = 0;
+  for (size_t i = 0; i < numLines; i++) {
+    double speed = fmax(fabs(lines[i]->velocity.x),
+                        fabs(lines[i]->velocity.y));
+    maxSpeed = fmax(maxSpeed, speed);
+  }
+  double skin = skinFrames * maxSpeed * timeStep;
+
+  size_t numChunks = (numLines + SWEEP_CHUNK - 1) / SWEEP_CHUNK;
+  SweepEntry* order = malloc(numLines * sizeof(SweepEntry));
+  SweepChunk* chunks = calloc(numChunks, sizeof(SweepChunk));
+  if (order == NULL || chunks == NULL) {
+    free(chunks);
+    free(order);
+    return false;
+  }
+  for (size_t i = 0; i < numLines; i++) {
+    PairListBox* box = &pairList->boxes[i];
+    box->l_x = lines[i]->l_x - skin;
+    box->u_x = lines[i]->u_x + skin;
+    box->l_y = lines[i]->l_y - skin;
+    box->u_y = lines[i]->u_y + skin;
+    order[i].l_x = box->l_x;
+    order[i].index = i;
+  }
+  qsort(order, numLines, sizeof(SweepEntry), compareSweepEntries);
+
+  SweepArgs args;
+  args.pairList = pairList;
+  args.lines = lines;
+  args.order = order;
+  args.numLines = numLines;
+  args.chunks = chunks;
+  Parallel_for(numChunks, 1, sweepChunks, &args);
+
+  // The pairs of all the chunks replace the old ones.
+  bool appended = appendChunks(pairList, chunks, numChunks);
+  free(chunks);
+  free(order);
+  if (!appended) {
+    return false;
+  }
+
+  pairList->numLines = numLines;
+  pairList->skin = skin;
+  pairList->age = 0;
+  pairList->numBuilds++;
+  pairList->valid = true;
+  return true;
+}
+
+// Pairs every line added since the last build with the earlier lines of the
+// given chunks whose grown boxes overlap its own.
+static void extendChunks(size_t begin, size_t end, void* arg) {
+  ExtendArgs* args = arg;
+  const PairListBox* boxes = args->pairList->boxes;
+  for (size_t c = begin; c < end; c++) {
+    SweepChunk* chunk = &args->chunks[c];
+    size_t first = c * EXTEND_CHUNK;
+    size_t last = first + EXTEND_CHUNK;
+    for (size_t i = args->firstNew; i < args->numLines; i++) {
+      const PairListBox* box = &boxes[i];
+      size_t stop = (last < i) ? last : i;
+      for (size_t j = first; j < stop; j++) {
+        const PairListBox* other = &boxes[j];
+        if (box->l_x <= other->u_x && box->u_x >= other->l_x
+            && box->l_y <= other->u_y && box->u_y >= other->l_y) {
+          appendPair(chunk, args->lines, j, i);
+        }
+      }
+    }
+  }
+}
+
+bool PairList_extend(PairList* pairList, Line** lines, size_t numLines) {
+  assert(pairList->valid && pairList->numLines <= numLines);
+  assert(numLines <= pairList->capacity);
+  double skin = pairList->skin;
+  for (size_t i = pairList->numLines; i < numLines; i++) {
+    PairListBox* box = &pairList->boxes[i];
+    box->l_x = lines[i]->l_x - skin;
+    box->u_x = lines[i]->u_x + skin;
+    box->l_y = lines[i]->l_y - skin;
+    box->u_y = lines[i]->u_y + skin;
+  }
+
+  ExtendArgs args;
+  args.pairList = pairList;
+  args.lines = lines;
+  args.firstNew = pairList->numLines;
+  args.numLines = numLines;
+  size_t numChunks = (numLines + EXTEND_CHUNK - 1) / EXTEND_CHUNK;
+  args.chunks = calloc(numChunks, sizeof(SweepChunk));
+  if (args.chunks == NULL) {
+    pairList->valid = false;
+    return false;
+  }
+  Parallel_for(numChunks, 1, extendChunks, &args);
+  bool appended = appendChunks(pairList, args.chunks, numChunks);
+  free(args.chunks);
+  if (!appended) {
+    pairList->valid = false;
+    return false;
+  }
+  pairList->numLines = numLines;
+  return true;
+}
+
+bool PairList_grow(PairList* pairList, size_t capacity) {
+  assert(capacity >= pairList->capacity);
+  PairListBox* boxes = realloc(pairList->boxes,
+                               capacity * sizeof(PairListBox));
+  if (boxes == NULL) {
+    return false;
+  }
+  pairList->boxes = boxes;
+  pairList->capacity = capacity;
+  return true;
+}
+
+void PairList_removeLine(PairList* pairList, Line** lines, size_t i,
+                         size_t last) {
+  assert(i <= last);
+  if (!pairList->valid || i >= pairList->numLines) {
+    return;
+  }
+  if (last >= pairList->numLines) {
+    pairList->valid = false;
+    return;
+  }
+  size_t numKept = 0;
+  for (size_t p = 0; p < pairList->numPairs; p++) {
+    LinePair pair = pairList->pairs[p];
+    if (pair.i1 == i || pair.i2 == i) {
+      continue;
+    }
+    if (pair.i1 == last) {
+      pair.i1 = i;
+      pair.l1 = lines[i];
+    } else if (pair.i2 == last) {
+      pair.i2 = i;
+      pair.l2 = lines[i];
+    }
+    pairList->pairs[numKept++] = pair;
+  }
+  pairList->numPairs = numKept;
+  pairList->boxes[i] = pairList->boxes[last];
+  pairList->numLines = last;
+}
+
+void PairList_rebase(PairList* pairList, Line** lines) {
+  for (size_t p = 0; p < pairList->numPairs; p++) {
+    LinePair* pair = &pairList->pairs[p];
+    pair->l1 = lines[pair->i1];
+    pair->l2 = lines[pair->i2];
+  }
+}
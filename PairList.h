@@ -0,0 +1,141 @@
+/**
+ * PairList.h -- candidate pairs of lines reused across frames
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef PAIRLIST_H_
+#define PAIRLIST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./Line.h"
+
+// By default, the skin grows every line's swept box by this many time steps
+// of travel at the largest line speed, on every side.
+#define PAIR_LIST_SKIN_FRAMES 4
+
+// The list is rebuilt after this many frames even if no line has left its
+// grown box.
+#define PAIR_LIST_MAX_FRAMES 16
+
+// At most this many lines added since the last build are appended to the
+// list by PairList_extend; more are cheaper to take in with a rebuild.
+#define PAIR_LIST_MAX_EXTEND 64
+
+// A candidate pair, with the lines' indices in the array the list was built
+// from.  Precondition: compareLines(l1, l2) < 0.
+struct LinePair {
+  Line* l1;
+  Line* l2;
+  size_t i1, i2;
+};
+typedef struct LinePair LinePair;
+
+// The swept box of a line at the last build, grown by the skin.
+struct PairListBox {
+  double l_x, u_x, l_y, u_y;
+};
+typedef struct PairListBox PairListBox;
+
+// A Verlet-style list of the pairs of lines whose swept boxes, grown by the
+// skin, overlap.  While every line's swept box stays inside its grown box,
+// any two lines whose swept boxes overlap are in the list, so testing the
+// listed pairs finds the same intersections as testing every pair.
+struct PairList {
+  // Candidate pairs, not in any particular order.
+  LinePair* pairs;
+  size_t numPairs;
+  size_t pairCapacity;
+
+  // Grown box of each line, indexed like the lines the list was built from.
+  PairListBox* boxes;
+  size_t numLines;
+  size_t capacity;
+
+  // Distance the boxes were grown by on every side.
+  double skin;
+
+  // Frames the list has been used for since it was last built, and the
+  // number of builds so far.
+  unsigned int age;
+  uint64_t numBuilds;
+
+  // Cleared when lines are moved in the array the list was built from, which
+  // makes it expire.
+  bool valid;
+};
+typedef struct PairList PairList;
+
+// Returns an empty list for up to capacity lines, or NULL if it cannot be
+// allocated.
+PairList* PairList_new(size_t capacity);
+
+// Does nothing if pairList is NULL.
+void PairList_delete(PairList* pairList);
+
+// Rebuilds the list from the first numLines of lines by sorting their grown
+// boxes and sweeping along x.  The boxes are grown by skinFrames time steps
+// of travel at the largest line speed.  The lines' swept boxes must be up to
+// date (see update_box).  Returns false, leaving the list invalid, if the
+// pairs cannot be allocated.
+bool PairList_build(PairList* pairList, Line** lines, size_t numLines,
+                    double timeStep, unsigned int skinFrames);
+
+// Appends the lines [pairList->numLines, numLines) of lines, which were
+// added after the last build, to the list: their boxes are grown by the
+// list's skin, and each of them is paired with every line before it whose
+// grown box overlaps its own.  The lines' swept boxes must be up to date.
+// Returns false, leaving the list invalid, if the pairs cannot be allocated.
+bool PairList_extend(PairList* pairList, Line** lines, size_t numLines);
+
+// Makes room for up to capacity lines.  Returns false, leaving the list
+// unchanged, if the memory cannot be allocated.
+bool PairList_grow(PairList* pairList, size_t capacity);
+
+// Points the pairs at the lines of the given array, which holds the lines
+// the list was built from at the same indices.
+void PairList_rebase(PairList* pairList, Line** lines);
+
+// Removes line i of lines, into whose slot the line at last was just moved,
+// dropping its pairs and moving the moved line's pairs and box to slot i.
+// Lines not yet in the list are left to PairList_extend; if only the moved
+// line is missing, the list is invalidated instead.
+void PairList_removeLine(PairList* pairList, Line** lines, size_t i,
+                         size_t last);
+
+// Whether the line, the index-th of those the list was built from, still has
+// its up-to-date swept box inside its grown box.
+static inline bool PairList_holds(const PairList* pairList,
+                                  size_t index, const Line* line) {
+  const PairListBox* box = &pairList->boxes[index];
+  return line->l_x >= box->l_x && line->u_x <= box->u_x
+      && line->l_y >= box->l_y && line->u_y <= box->u_y;
+}
+
+// Whether the list must be rebuilt regardless of where the lines are: it
+// was never built, it was invalidated, it holds more lines than numLines or
+// more than PAIR_LIST_MAX_EXTEND fewer, or it has been used for
+// PAIR_LIST_MAX_FRAMES frames.
+bool PairList_isExpired(const PairList* pairList, size_t numLines);
+
+#endif  // PAIRLIST_H_
@@ -0,0 +1,563 @@
+/**
+ * Parallel.c -- portable fork-join runtime layer
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+// For CPU affinity.
+#define _GNU_SOURCE
+
+#include "./Parallel.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined(PARALLEL_OPENMP)
+#include <omp.h>
+#elif defined(PARALLEL_PTHREAD)
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#elif defined(PARALLEL_OPENCILK) || defined(PARALLEL_CILKPLUS)
+#include <stdio.h>
+#include <cilk/cilk.h>
+#include <cilk/cilk_api.h>
+#endif
+
+static bool initialized = false;
+static int numWorkers = 1;
+
+// Number of calls to Parallel_serial the calling thread is inside of.  While
+// it is positive, every parallel construct runs inline.
+static __thread int serialDepth = 0;
+
+#ifndef PARALLEL_SERIAL
+
+// Arguments of the part of a Parallel_forStatic loop that runs on one worker.
+struct StaticBlock {
+  size_t begin;
+  size_t end;
+  ParallelLoopBody body;
+  void* arg;
+};
+typedef struct StaticBlock StaticBlock;
+
+// The first n % numWorkers blocks get one extra iteration.
+static size_t blockStart(size_t n, int w) {
+  size_t size = n / numWorkers;
+  size_t extra = n % numWorkers;
+  return size * w + ((size_t) w < extra ? (size_t) w : extra);
+}
+
+// Returns block w of [0, n) split across numWorkers workers.
+static StaticBlock staticBlock(size_t n, int w, ParallelLoopBody body,
+                               void* arg) {
+  StaticBlock block = { blockStart(n, w), blockStart(n, w + 1), body, arg };
+  return block;
+}
+
+static void runStaticBlock(void* arg) {
+  StaticBlock* block = arg;
+  if (block->begin < block->end) {
+    block->body(block->begin, block->end, block->arg);
+  }
+}
+
+#endif
+
+#if defined(PARALLEL_OPENMP) || defined(PARALLEL_PTHREAD)
+// Reads the requested number of workers from PAR_NWORKERS.
+static int requestedWorkers(void) {
+  const char* value = getenv("PAR_NWORKERS");
+  int workers = (value != NULL) ? atoi(value) : 0;
+  if (workers <= 0) {
+    workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  }
+  return (workers > 0) ? workers : 1;
+}
+#endif
+
+#if defined(PARALLEL_OPENMP)
+
+// Whether the calling thread is inside the runtime's parallel region.  Nested
+// invocations create tasks in the region instead of opening a new one.
+static __thread bool inRegion = false;
+
+static void startRuntime(void) {
+  numWorkers = requestedWorkers();
+  omp_set_num_threads(numWorkers);
+}
+
+const char* Parallel_getBackendName(void) {
+  return "openmp";
+}
+
+int Parallel_getWorkerNumber(void) {
+  return inRegion ? omp_get_thread_num() : 0;
+}
+
+static void invokeTasks(ParallelTask task, char* args, size_t argSize,
+                        int n) {
+  for (int i = 0; i < n - 1; i++) {
+    #pragma omp task firstprivate(i)
+    task(args + i * argSize);
+  }
+  task(args + (n - 1) * argSize);
+  #pragma omp taskwait
+}
+
+void Parallel_invoke(ParallelTask task, void* args, size_t argSize, int n) {
+  Parallel_init();
+  if (numWorkers == 1 || serialDepth > 0) {
+    for (int i = 0; i < n; i++) {
+      task((char*) args + i * argSize);
+    }
+    return;
+  }
+  if (n <= 0) {
+    return;
+  }
+  if (inRegion) {
+    invokeTasks(task, args, argSize, n);
+    return;
+  }
+  #pragma omp parallel num_threads(numWorkers)
+  {
+    inRegion = true;
+    #pragma omp single
+    invokeTasks(task, args, argSize, n);
+    inRegion = false;
+  }
+}
+
+void Parallel_forStatic(size_t n, ParallelLoopBody body, void* arg) {
+  Parallel_init();
+  if (numWorkers == 1 || inRegion || serialDepth > 0) {
+    body(0, n, arg);
+    return;
+  }
+  #pragma omp parallel num_threads(numWorkers)
+  {
+    StaticBlock block = staticBlock(n, omp_get_thread_num(), body, arg);
+    runStaticBlock(&block);
+  }
+}
+
+#elif defined(PARALLEL_PTHREAD)
+
+// Number of tasks a worker's deque can hold.  A task that does not fit runs
+// immediately on the worker that created it.
+#define DEQUE_SIZE 1024
+
+struct PoolTask {
+  ParallelTask task;
+  void* arg;
+  // Counts the unfinished tasks of the invocation this task belongs to.
+  atomic_int* pending;
+};
+typedef struct PoolTask PoolTask;
+
+// A worker's deque.  The worker pushes and pops at the bottom; thieves steal
+// from the top.  The mailbox holds a task that only this worker may run.
+struct Deque {
+  pthread_mutex_t lock;
+  int top;
+  int bottom;
+  bool hasMail;
+  PoolTask mail;
+  PoolTask tasks[DEQUE_SIZE];
+} __attribute__((aligned(64)));
+typedef struct Deque Deque;
+
+static Deque* deques = NULL;
+
+// Tasks sitting in any deque.  Idle workers sleep while it is zero.
+static atomic_int numQueued = 0;
+static atomic_int numSleeping = 0;
+static pthread_mutex_t sleepLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t workAvailable = PTHREAD_COND_INITIALIZER;
+
+static __thread int workerNumber = 0;
+
+static bool push(Deque* deque, PoolTask* task) {
+  pthread_mutex_lock(&deque->lock);
+  bool pushed = deque->bottom - deque->top < DEQUE_SIZE;
+  if (pushed) {
+    deque->tasks[deque->bottom % DEQUE_SIZE] = *task;
+    deque->bottom++;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  if (pushed) {
+    atomic_fetch_add(&numQueued, 1);
+    if (atomic_load(&numSleeping) > 0) {
+      pthread_mutex_lock(&sleepLock);
+      pthread_cond_signal(&workAvailable);
+      pthread_mutex_unlock(&sleepLock);
+    }
+  }
+  return pushed;
+}
+
+// Puts a task into the worker's mailbox, which must be empty.
+static void post(Deque* deque, PoolTask* task) {
+  pthread_mutex_lock(&deque->lock);
+  assert(!deque->hasMail);
+  deque->mail = *task;
+  deque->hasMail = true;
+  pthread_mutex_unlock(&deque->lock);
+  atomic_fetch_add(&numQueued, 1);
+  // Only the addressee can take the task, so wake every sleeper.
+  if (atomic_load(&numSleeping) > 0) {
+    pthread_mutex_lock(&sleepLock);
+    pthread_cond_broadcast(&workAvailable);
+    pthread_mutex_unlock(&sleepLock);
+  }
+}
+
+static bool pop(Deque* deque, PoolTask* task) {
+  pthread_mutex_lock(&deque->lock);
+  bool popped = deque->hasMail || deque->bottom > deque->top;
+  if (deque->hasMail) {
+    *task = deque->mail;
+    deque->hasMail = false;
+  } else if (popped) {
+    deque->bottom--;
+    *task = deque->tasks[deque->bottom % DEQUE_SIZE];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  if (popped) {
+    atomic_fetch_sub(&numQueued, 1);
+  }
+  return popped;
+}
+
+static bool steal(Deque* deque, PoolTask* task) {
+  pthread_mutex_lock(&deque->lock);
+  bool stolen = deque->bottom > deque->top;
+  if (stolen) {
+    *task = deque->tasks[deque->top % DEQUE_SIZE];
+    deque->top++;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  if (stolen) {
+    atomic_fetch_sub(&numQueued, 1);
+  }
+  return stolen;
+}
+
+static void runTask(PoolTask* task) {
+  task->task(task->arg);
+  atomic_fetch_sub_explicit(task->pending, 1, memory_order_release);
+}
+
+// Takes a task from the calling worker's deque, or else steals one from the
+// other workers, starting with the next one over.
+static bool findTask(PoolTask* task) {
+  if (pop(&deques[workerNumber], task)) {
+    return true;
+  }
+  for (int i = 1; i < numWorkers; i++) {
+    if (steal(&deques[(workerNumber + i) % numWorkers], task)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Pins the calling thread to the processor for worker w, picked among the
+// processors the process was allowed to run on when the pool started.
+static cpu_set_t allowedCpus;
+static int numAllowedCpus = 0;
+
+static void pinWorker(int w) {
+  if (numAllowedCpus == 0) {
+    return;
+  }
+  int skip = w % numAllowedCpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowedCpus) && skip-- == 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+      if (error != 0) {
+        errno = error;
+        perror("pthread_setaffinity_np");
+      }
+      return;
+    }
+  }
+}
+
+static void* workerMain(void* arg) {
+  workerNumber = (int) (size_t) arg;
+  pinWorker(workerNumber);
+  while (true) {
+    PoolTask task;
+    if (findTask(&task)) {
+      runTask(&task);
+      continue;
+    }
+    // Work may be queued that only another worker can take.
+    sched_yield();
+    if (findTask(&task)) {
+      runTask(&task);
+      continue;
+    }
+    pthread_mutex_lock(&sleepLock);
+    atomic_fetch_add(&numSleeping, 1);
+    while (atomic_load(&numQueued) == 0) {
+      pthread_cond_wait(&workAvailable, &sleepLock);
+    }
+    atomic_fetch_sub(&numSleeping, 1);
+    pthread_mutex_unlock(&sleepLock);
+  }
+  return NULL;
+}
+
+static void startRuntime(void) {
+  numWorkers = requestedWorkers();
+  deques = calloc(numWorkers, sizeof(Deque));
+  if (deques == NULL) {
+    numWorkers = 1;
+    return;
+  }
+  for (int w = 0; w < numWorkers; w++) {
+    pthread_mutex_init(&deques[w].lock, NULL);
+  }
+  const char* pin = getenv("PAR_PIN");
+  if ((pin == NULL || atoi(pin) != 0)
+      && sched_getaffinity(0, sizeof(allowedCpus), &allowedCpus) == 0) {
+    numAllowedCpus = CPU_COUNT(&allowedCpus);
+  }
+  // The thread that starts the runtime is worker 0.
+  pinWorker(0);
+  for (int w = 1; w < numWorkers; w++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, workerMain, (void*) (size_t) w) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+    pthread_detach(thread);
+  }
+}
+
+const char* Parallel_getBackendName(void) {
+  return "pthread";
+}
+
+int Parallel_getWorkerNumber(void) {
+  return workerNumber;
+}
+
+void Parallel_invoke(ParallelTask task, void* args, size_t argSize, int n) {
+  Parallel_init();
+  if (numWorkers == 1 || serialDepth > 0) {
+    for (int i = 0; i < n; i++) {
+      task((char*) args + i * argSize);
+    }
+    return;
+  }
+  if (n <= 0) {
+    return;
+  }
+
+  atomic_int pending = n - 1;
+  for (int i = 0; i < n - 1; i++) {
+    PoolTask child = { task, (char*) args + i * argSize, &pending };
+    if (!push(&deques[workerNumber], &child)) {
+      runTask(&child);
+    }
+  }
+  task((char*) args + (n - 1) * argSize);
+
+  // Help out until the other tasks are done.
+  while (atomic_load_explicit(&pending, memory_order_acquire) > 0) {
+    PoolTask other;
+    if (findTask(&other)) {
+      runTask(&other);
+    } else {
+      sched_yield();
+    }
+  }
+}
+
+void Parallel_forStatic(size_t n, ParallelLoopBody body, void* arg) {
+  Parallel_init();
+  if (numWorkers == 1 || workerNumber != 0 || serialDepth > 0) {
+    body(0, n, arg);
+    return;
+  }
+
+  StaticBlock blocks[numWorkers];
+  atomic_int pending = numWorkers - 1;
+  for (int w = 1; w < numWorkers; w++) {
+    blocks[w] = staticBlock(n, w, body, arg);
+    PoolTask task = { runStaticBlock, &blocks[w], &pending };
+    post(&deques[w], &task);
+  }
+  blocks[0] = staticBlock(n, 0, body, arg);
+  runStaticBlock(&blocks[0]);
+
+  while (atomic_load_explicit(&pending, memory_order_acquire) > 0) {
+    PoolTask other;
+    if (findTask(&other)) {
+      runTask(&other);
+    } else {
+      sched_yield();
+    }
+  }
+}
+
+#elif defined(PARALLEL_OPENCILK) || defined(PARALLEL_CILKPLUS)
+
+static void startRuntime(void) {
+  // The Cilk runtimes size themselves from CILK_NWORKERS when they start, so
+  // pass PAR_NWORKERS along unless CILK_NWORKERS is already set.
+  const char* value = getenv("PAR_NWORKERS");
+  if (value != NULL && getenv("CILK_NWORKERS") == NULL) {
+    setenv("CILK_NWORKERS", value, 0);
+  }
+  numWorkers = __cilkrts_get_nworkers();
+}
+
+const char* Parallel_getBackendName(void) {
+#ifdef PARALLEL_OPENCILK
+  return "opencilk";
+#else
+  return "cilkplus";
+#endif
+}
+
+int Parallel_getWorkerNumber(void) {
+  return __cilkrts_get_worker_number();
+}
+
+void Parallel_invoke(ParallelTask task, void* args, size_t argSize, int n) {
+  Parallel_init();
+  if (serialDepth > 0) {
+    for (int i = 0; i < n; i++) {
+      task((char*) args + i * argSize);
+    }
+    return;
+  }
+  for (int i = 0; i < n - 1; i++) {
+    cilk_spawn task((char*) args + i * argSize);
+  }
+  if (n > 0) {
+    task((char*) args + (n - 1) * argSize);
+  }
+  cilk_sync;
+}
+
+// The Cilk runtimes cannot direct work at a particular worker, so the blocks
+// only keep their boundaries here.
+void Parallel_forStatic(size_t n, ParallelLoopBody body, void* arg) {
+  Parallel_init();
+  if (serialDepth > 0) {
+    body(0, n, arg);
+    return;
+  }
+  cilk_for (int w = 0; w < numWorkers; w++) {
+    StaticBlock block = staticBlock(n, w, body, arg);
+    runStaticBlock(&block);
+  }
+}
+
+#else  // PARALLEL_SERIAL
+
+static void startRuntime(void) {
+  numWorkers = 1;
+}
+
+const char* Parallel_getBackendName(void) {
+  return "serial";
+}
+
+int Parallel_getWorkerNumber(void) {
+  return 0;
+}
+
+void Parallel_invoke(ParallelTask task, void* args, size_t argSize, int n) {
+  for (int i = 0; i < n; i++) {
+    task((char*) args + i * argSize);
+  }
+}
+
+void Parallel_forStatic(size_t n, ParallelLoopBody body, void* arg) {
+  body(0, n, arg);
+}
+
+#endif
+
+void Parallel_init(void) {
+  if (!initialized) {
+    initialized = true;
+    startRuntime();
+  }
+}
+
+int Parallel_getNumWorkers(void) {
+  Parallel_init();
+  return numWorkers;
+}
+
+void Parallel_serial(ParallelTask task, void* arg) {
+  serialDepth++;
+  task(arg);
+  serialDepth--;
+}
+
+struct LoopRange {
+  size_t begin;
+  size_t end;
+  size_t grain;
+  ParallelLoopBody body;
+  void* arg;
+};
+typedef struct LoopRange LoopRange;
+
+// Splits the range in half until it is no larger than the grain.
+static void loopTask(void* arg) {
+  LoopRange* range = arg;
+  if (range->end - range->begin <= range->grain) {
+    range->body(range->begin, range->end, range->arg);
+    return;
+  }
+  size_t middle = range->begin + (range->end - range->begin) / 2;
+  LoopRange halves[2] = {
+    { range->begin, middle, range->grain, range->body, range->arg },
+    { middle, range->end, range->grain, range->body, range->arg }
+  };
+  Parallel_invoke(loopTask, halves, sizeof(LoopRange), 2);
+}
+
+void Parallel_for(size_t n, size_t grain, ParallelLoopBody body, void* arg) {
+  assert(grain > 0);
+  if (n == 0) {
+    return;
+  }
+  LoopRange range = { 0, n, grain, body, arg };
+  loopTask(&range);
+}
@@ -0,0 +1,89 @@
+/**
+ * Parallel.h -- portable fork-join runtime layer
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <stddef.h>
+
+// The parallel backend is chosen when building ("make PARALLEL=<backend>"):
+//
+//   PARALLEL_OPENMP    OpenMP tasks (the default)
+//   PARALLEL_PTHREAD   the built-in work-stealing pool on POSIX threads
+//   PARALLEL_OPENCILK  OpenCilk cilk_spawn/cilk_sync
+//   PARALLEL_CILKPLUS  Cilk Plus cilk_spawn/cilk_sync
+//   PARALLEL_SERIAL    everything runs on the calling thread
+//
+// The number of workers comes from the PAR_NWORKERS environment variable and
+// defaults to the number of online processors.  The pthread pool pins worker w
+// to the w-th processor the process may run on unless PAR_PIN=0; with OpenMP,
+// set OMP_PROC_BIND and OMP_PLACES instead.
+#if !defined(PARALLEL_OPENMP) && !defined(PARALLEL_PTHREAD) \
+    && !defined(PARALLEL_OPENCILK) && !defined(PARALLEL_CILKPLUS) \
+    && !defined(PARALLEL_SERIAL)
+#define PARALLEL_SERIAL
+#endif
+
+// A task takes a pointer to its own argument block.
+typedef void (*ParallelTask)(void* arg);
+
+// A loop body handles the iterations [begin, end).
+typedef void (*ParallelLoopBody)(size_t begin, size_t end, void* arg);
+
+// Starts the runtime.  Calling it again does nothing; the other functions
+// call it themselves if needed.
+void Parallel_init(void);
+
+// Returns the name of the backend compiled in.
+const char* Parallel_getBackendName(void);
+
+// Returns the number of workers.
+int Parallel_getNumWorkers(void);
+
+// Returns the number of the calling worker, in [0, Parallel_getNumWorkers()).
+// Threads outside the runtime count as worker 0.
+int Parallel_getWorkerNumber(void);
+
+// Runs task on each of the n argument blocks laid out argSize bytes apart
+// starting at args, possibly in parallel, and returns once all of them are
+// done.  The last block runs on the calling worker.
+void Parallel_invoke(ParallelTask task, void* args, size_t argSize, int n);
+
+// Calls body on disjoint ranges covering [0, n), possibly in parallel.  Each
+// range has at most grain iterations.  Returns once all of them are done.
+void Parallel_for(size_t n, size_t grain, ParallelLoopBody body, void* arg);
+
+// Splits [0, n) into Parallel_getNumWorkers() contiguous blocks of nearly
+// equal size and calls body on block w from worker w.  Calls with the same n
+// give every worker the same block, so data first touched through this
+// function stays local to the worker that keeps updating it.  Must be called
+// from worker 0 outside any task.
+void Parallel_forStatic(size_t n, ParallelLoopBody body, void* arg);
+
+// Runs task(arg) on the calling worker, and every Parallel_invoke,
+// Parallel_for and Parallel_forStatic made from it as well.  Computations
+// too small to be worth splitting can then run side by side, one per task;
+// Parallel_forStatic may be called from any worker inside task.
+void Parallel_serial(ParallelTask task, void* arg);
+
+#endif  // PARALLEL_H_
@@ -0,0 +1,235 @@
+/**
+ * PerfCounters.c -- hardware performance counters per simulation phase
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./PerfCounters.h"
+
+#ifdef PERF_COUNTERS
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Upper bound on the number of threads that can attach counters.
+#define MAX_THREADS 256
+
+static const char* counterNames[NUM_COUNTERS] = {
+  "cycles",
+  "instructions",
+  "LLC-misses",
+  "branch-misses",
+  "dTLB-misses"
+};
+
+// The counters of one thread, opened as a single group so that they can be
+// read with one system call.
+struct PerfThread {
+  // Group leader, or -1 if nothing could be opened.
+  int leader;
+  int fds[NUM_COUNTERS];
+  // Group members in the order read() returns them.
+  int numOpen;
+  Counter order[NUM_COUNTERS];
+  // Counter values at the start of the current phase.
+  uint64_t start[NUM_COUNTERS];
+};
+typedef struct PerfThread PerfThread;
+
+static bool enabled = false;
+static PerfThread threads[MAX_THREADS];
+static int numThreads = 0;
+static pthread_mutex_t attachLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Index of the calling thread in threads, -1 if it has not attached yet and
+// -2 if attaching failed.
+static __thread int self = -1;
+
+// Which counters could be opened on the thread that enabled collection.
+static bool available[NUM_COUNTERS];
+
+static uint64_t totals[NUM_PHASES][NUM_COUNTERS];
+
+static void initAttr(struct perf_event_attr* attr, Counter counter) {
+  memset(attr, 0, sizeof(*attr));
+  attr->size = sizeof(*attr);
+  attr->read_format = PERF_FORMAT_GROUP;
+  attr->exclude_kernel = 1;
+  attr->exclude_hv = 1;
+  switch (counter) {
+    case COUNTER_CYCLES:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case COUNTER_INSTRUCTIONS:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case COUNTER_LLC_MISSES:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    case COUNTER_BRANCH_MISSES:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+    case COUNTER_DTLB_MISSES:
+      attr->type = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_DTLB
+          | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    default:
+      break;
+  }
+}
+
+// Opens as many of the counters as the hardware and kernel allow for the
+// calling thread.  Returns the number opened.
+static int openCounters(PerfThread* thread) {
+  thread->leader = -1;
+  thread->numOpen = 0;
+  for (int c = 0; c < NUM_COUNTERS; c++) {
+    struct perf_event_attr attr;
+    initAttr(&attr, (Counter) c);
+    int fd = syscall(__NR_perf_event_open, &attr, 0, -1, thread->leader, 0);
+    thread->fds[c] = fd;
+    if (fd < 0) {
+      continue;
+    }
+    if (thread->leader < 0) {
+      thread->leader = fd;
+    }
+    thread->order[thread->numOpen++] = (Counter) c;
+    thread->start[c] = 0;
+  }
+  return thread->numOpen;
+}
+
+// Reads the thread's counters into values, indexed by Counter.
+static bool readCounters(PerfThread* thread, uint64_t* values) {
+  uint64_t buffer[1 + NUM_COUNTERS];
+  ssize_t size = read(thread->leader, buffer, sizeof(buffer));
+  if (size < (ssize_t) sizeof(uint64_t)) {
+    return false;
+  }
+  for (int i = 0; i < thread->numOpen && i < (int) buffer[0]; i++) {
+    values[thread->order[i]] = buffer[1 + i];
+  }
+  return true;
+}
+
+void PerfCounters_attachThread(void) {
+  if (!enabled || self != -1) {
+    return;
+  }
+
+  pthread_mutex_lock(&attachLock);
+  self = -2;
+  if (numThreads < MAX_THREADS) {
+    PerfThread* thread = &threads[numThreads];
+    if (openCounters(thread) > 0) {
+      self = numThreads;
+      // Publish the fully initialized entry to the phase boundary readers.
+      __atomic_store_n(&numThreads, numThreads + 1, __ATOMIC_RELEASE);
+    }
+  }
+  pthread_mutex_unlock(&attachLock);
+}
+
+bool PerfCounters_enable(void) {
+  enabled = true;
+  PerfCounters_attachThread();
+  if (self < 0) {
+    enabled = false;
+    return false;
+  }
+  for (int i = 0; i < threads[self].numOpen; i++) {
+    available[threads[self].order[i]] = true;
+  }
+  return true;
+}
+
+void PerfCounters_phaseBegin(Phase phase) {
+  if (!enabled) {
+    return;
+  }
+  int n = __atomic_load_n(&numThreads, __ATOMIC_ACQUIRE);
+  for (int t = 0; t < n; t++) {
+    readCounters(&threads[t], threads[t].start);
+  }
+}
+
+void PerfCounters_phaseEnd(Phase phase) {
+  if (!enabled) {
+    return;
+  }
+  int n = __atomic_load_n(&numThreads, __ATOMIC_ACQUIRE);
+  for (int t = 0; t < n; t++) {
+    PerfThread* thread = &threads[t];
+    uint64_t values[NUM_COUNTERS] = { 0 };
+    if (!readCounters(thread, values)) {
+      continue;
+    }
+    for (int i = 0; i < thread->numOpen; i++) {
+      Counter c = thread->order[i];
+      totals[phase][c] += values[c] - thread->start[c];
+      thread->start[c] = values[c];
+    }
+  }
+}
+
+void PerfCounters_report(FILE* out) {
+  if (!enabled) {
+    return;
+  }
+
+  fprintf(out, "---- PERF COUNTERS (%d threads) ----\n", numThreads);
+  fprintf(out, "%-18s", "phase");
+  for (int c = 0; c < NUM_COUNTERS; c++) {
+    fprintf(out, " %15s", counterNames[c]);
+  }
+  fprintf(out, " %6s\n", "IPC");
+  for (int p = 0; p < NUM_PHASES; p++) {
+    fprintf(out, "%-18s", Phase_name((Phase) p));
+    for (int c = 0; c < NUM_COUNTERS; c++) {
+      if (available[c]) {
+        fprintf(out, " %15llu", (unsigned long long) totals[p][c]);
+      } else {
+        fprintf(out, " %15s", "n/a");
+      }
+    }
+    uint64_t cycles = totals[p][COUNTER_CYCLES];
+    uint64_t instructions = totals[p][COUNTER_INSTRUCTIONS];
+    if (available[COUNTER_CYCLES] && available[COUNTER_INSTRUCTIONS]
+        && cycles > 0) {
+      fprintf(out, " %6.2f\n", (double) instructions / cycles);
+    } else {
+      fprintf(out, " %6s\n", "n/a");
+    }
+  }
+  fprintf(out, "---- END PERF COUNTERS ----\n");
+}
+
+#endif  // PERF_COUNTERS
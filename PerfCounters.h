@@ -0,0 +1,75 @@
+/**
+ * PerfCounters.h -- hardware performance counters per simulation phase
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef PERFCOUNTERS_H_
+#define PERFCOUNTERS_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "./PhaseTiming.h"
+
+// The hardware events counted around each phase.
+typedef enum {
+  COUNTER_CYCLES,
+  COUNTER_INSTRUCTIONS,
+  COUNTER_LLC_MISSES,
+  COUNTER_BRANCH_MISSES,
+  COUNTER_DTLB_MISSES,
+  NUM_COUNTERS
+} Counter;
+
+// Counters are only compiled in when building with PERF_COUNTERS defined
+// ("make PERF_COUNTERS=1", which also turns on PHASE_TIMING), and are only
+// collected after PerfCounters_enable() succeeds.
+//
+// Every thread that does simulation work opens its own set of counters the
+// first time it reaches PERF_ATTACH_THREAD().  At each phase boundary the
+// counters of all attached threads are read and their deltas are summed
+// into that phase's totals.
+#ifdef PERF_COUNTERS
+
+// Opens the counters for the calling thread and starts collecting.  Returns
+// false if perf_event_open is not available (for example, because of
+// /proc/sys/kernel/perf_event_paranoid).
+bool PerfCounters_enable(void);
+
+// Opens the counters for the calling thread if it has none yet.
+void PerfCounters_attachThread(void);
+
+// Called by PhaseTiming at the start and end of each phase.
+void PerfCounters_phaseBegin(Phase phase);
+void PerfCounters_phaseEnd(Phase phase);
+
+// Prints the per-phase totals and derived ratios.
+void PerfCounters_report(FILE* out);
+
+#define PERF_ATTACH_THREAD() PerfCounters_attachThread()
+
+#else
+
+#define PERF_ATTACH_THREAD() ((void) 0)
+
+#endif  // PERF_COUNTERS
+
+#endif  // PERFCOUNTERS_H_
@@ -0,0 +1,177 @@
+/**
+ * PhaseTiming.c -- per-phase timers for the simulation loop
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./PhaseTiming.h"
+
+#ifdef PHASE_TIMING
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "./ktiming.h"
+#include "./PerfCounters.h"
+#include "./Trace.h"
+
+static const char* phaseNames[NUM_PHASES] = {
+  "build",
+  "traverse",
+  "sort",
+  "solve",
+  "updatePosition",
+  "lineWallCollision"
+};
+
+// Start mark of each phase that is currently being timed.
+static clockmark_t phaseStart[NUM_PHASES];
+
+// Time accumulated by each phase in the current frame.
+static uint64_t frameTime[NUM_PHASES];
+
+// Time accumulated by each phase over the whole run.
+static uint64_t totalTime[NUM_PHASES];
+
+// Per-frame samples, NUM_PHASES entries per frame.
+static uint64_t* samples = NULL;
+static size_t numFrames = 0;
+static size_t capacity = 0;
+
+const char* Phase_name(Phase phase) {
+  return phaseNames[phase];
+}
+
+// Reading the hardware counters costs system calls, so they are read
+// outside of the timed interval.
+void PhaseTiming_begin(Phase phase) {
+#ifdef PERF_COUNTERS
+  PerfCounters_phaseBegin(phase);
+#endif
+  phaseStart[phase] = ktiming_getmark();
+}
+
+void PhaseTiming_end(Phase phase) {
+  const clockmark_t end = ktiming_getmark();
+  frameTime[phase] += ktiming_diff_usec(&phaseStart[phase], &end);
+#ifdef TRACE
+  Trace_end(phaseStart[phase], phase, 0);
+#endif
+#ifdef PERF_COUNTERS
+  PerfCounters_phaseEnd(phase);
+#endif
+}
+
+void PhaseTiming_endFrame(void) {
+  if (numFrames == capacity) {
+    size_t newCapacity = (capacity == 0) ? 1024 : 2 * capacity;
+    uint64_t* newSamples = realloc(samples,
+        newCapacity * NUM_PHASES * sizeof(uint64_t));
+    if (newSamples == NULL) {
+      // Keep the totals going even if we run out of room for samples.
+      for (int p = 0; p < NUM_PHASES; p++) {
+        totalTime[p] += frameTime[p];
+        frameTime[p] = 0;
+      }
+      return;
+    }
+    samples = newSamples;
+    capacity = newCapacity;
+  }
+
+  uint64_t* frame = samples + numFrames * NUM_PHASES;
+  for (int p = 0; p < NUM_PHASES; p++) {
+    frame[p] = frameTime[p];
+    totalTime[p] += frameTime[p];
+    frameTime[p] = 0;
+  }
+  numFrames++;
+}
+
+uint64_t PhaseTiming_getNumFrames(void) {
+  return numFrames;
+}
+
+unsigned long long PhaseTiming_getTotal(Phase phase) {
+  return totalTime[phase];
+}
+
+void PhaseTiming_report(FILE* out) {
+  uint64_t total = 0;
+  for (int p = 0; p < NUM_PHASES; p++) {
+    total += totalTime[p];
+  }
+
+  fprintf(out, "---- PHASE TIMING (%zu frames) ----\n", numFrames);
+  fprintf(out, "%-18s %12s %7s %12s %12s %12s\n", "phase", "total(s)",
+          "share", "mean(us)", "min(us)", "max(us)");
+  for (int p = 0; p < NUM_PHASES; p++) {
+    uint64_t min = 0;
+    uint64_t max = 0;
+    for (size_t f = 0; f < numFrames; f++) {
+      uint64_t sample = samples[f * NUM_PHASES + p];
+      if (f == 0 || sample < min) {
+        min = sample;
+      }
+      if (sample > max) {
+        max = sample;
+      }
+    }
+    double mean = (numFrames > 0) ? (double) totalTime[p] / numFrames : 0.0;
+    double share = (total > 0) ? 100.0 * totalTime[p] / total : 0.0;
+    fprintf(out, "%-18s %12.6f %6.1f%% %12.3f %12.3f %12.3f\n",
+            phaseNames[p], totalTime[p] / 1e9, share, mean / 1e3,
+            min / 1e3, max / 1e3);
+  }
+  fprintf(out, "%-18s %12.6f\n", "total", total / 1e9);
+  fprintf(out, "---- END PHASE TIMING ----\n");
+}
+
+bool PhaseTiming_writeJSON(const char* path) {
+  FILE* out = fopen(path, "w");
+  if (out == NULL) {
+    return false;
+  }
+
+  // One phase per line, so the output is easy to pick apart with
+  // line-oriented tools as well as with a JSON parser.
+  fprintf(out, "{\n  \"frames\": %zu,\n  \"phases\": {\n", numFrames);
+  for (int p = 0; p < NUM_PHASES; p++) {
+    fprintf(out, "    \"%s\": {\"total_sec\": %.9f, \"samples_usec\": [",
+            phaseNames[p], totalTime[p] / 1e9);
+    for (size_t f = 0; f < numFrames; f++) {
+      fprintf(out, "%s%.3f", (f == 0) ? "" : ", ",
+              samples[f * NUM_PHASES + p] / 1e3);
+    }
+    fprintf(out, "]}%s\n", (p == NUM_PHASES - 1) ? "" : ",");
+  }
+  fprintf(out, "  }\n}\n");
+
+  return fclose(out) == 0;
+}
+
+void PhaseTiming_free(void) {
+  free(samples);
+  samples = NULL;
+  numFrames = 0;
+  capacity = 0;
+}
+
+#endif  // PHASE_TIMING
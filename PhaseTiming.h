@@ -0,0 +1,88 @@
+/**
+ * PhaseTiming.h -- per-phase timers for the simulation loop
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef PHASETIMING_H_
+#define PHASETIMING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// The phases of a single call to CollisionWorld_updateLines.
+typedef enum {
+  PHASE_BUILD,            // update_box and quadtree construction/teardown
+  PHASE_TRAVERSE,         // quadtree traversal for intersection events
+  PHASE_SORT,             // sorting the intersection event list
+  PHASE_SOLVE,            // collision solver over all events
+  PHASE_UPDATE_POSITION,  // CollisionWorld_updatePosition
+  PHASE_WALL,             // CollisionWorld_lineWallCollision
+  NUM_PHASES
+} Phase;
+
+// Phase timers are only compiled in when building with PHASE_TIMING defined
+// ("make PHASE_TIMING=1").  Otherwise PHASE_BEGIN, PHASE_END and
+// PHASE_END_FRAME expand to nothing.
+#ifdef PHASE_TIMING
+
+// Returns the human-readable name of the phase.
+const char* Phase_name(Phase phase);
+
+// Starts timing the phase.  Phases are timed from the thread driving the
+// simulation and must not nest with themselves.
+void PhaseTiming_begin(Phase phase);
+
+// Stops timing the phase and adds the elapsed time to the current frame.
+void PhaseTiming_end(Phase phase);
+
+// Closes the current frame's samples and starts a new frame.
+void PhaseTiming_endFrame(void);
+
+// Number of frames recorded so far.
+uint64_t PhaseTiming_getNumFrames(void);
+
+// Total time spent in the phase, in nanoseconds.
+unsigned long long PhaseTiming_getTotal(Phase phase);
+
+// Prints a per-phase summary table.
+void PhaseTiming_report(FILE* out);
+
+// Writes the totals and all per-frame samples as JSON.  Returns false if the
+// file could not be written.
+bool PhaseTiming_writeJSON(const char* path);
+
+// Releases the per-frame sample storage.
+void PhaseTiming_free(void);
+
+#define PHASE_BEGIN(phase) PhaseTiming_begin(phase)
+#define PHASE_END(phase) PhaseTiming_end(phase)
+#define PHASE_END_FRAME() PhaseTiming_endFrame()
+
+#else
+
+#define PHASE_BEGIN(phase) ((void) 0)
+#define PHASE_END(phase) ((void) 0)
+#define PHASE_END_FRAME() ((void) 0)
+
+#endif  // PHASE_TIMING
+
+#endif  // PHASETIMING_H_
@@ -26,6 +26,8 @@
 #include <assert.h>
 
 #include "./Line.h"
+#include "./PerfCounters.h"
+#include "./Trace.h"
 #include "./Vec.h"
 
 line_node* line_node_new(Line* line) {
@@ -39,6 +41,7 @@ quad_tree *quad_tree_new(double xmin, double xmax, double ymin, double ymax) {
   root->quad1 = root->quad2 = root->quad3 = root->quad4 = NULL;
   root->lines = NULL;
   root->num_lines = 0;
+  root->num_own_lines = 0;
   root->xmin = xmin;
   root->xmax = xmax;
   root->ymin = ymin;
@@ -59,6 +62,18 @@ void quad_tree_delete(quad_tree * tree) {
   free(tree);
 }
 
+void quad_tree_shape(quad_tree* tree, unsigned int depth,
+                     size_t* num_nodes, unsigned int* max_depth) {
+  if (tree == NULL) return;
+  (*num_nodes)++;
+  if (depth > *max_depth)
+    *max_depth = depth;
+  quad_tree_shape(tree->quad1, depth + 1, num_nodes, max_depth);
+  quad_tree_shape(tree->quad2, depth + 1, num_nodes, max_depth);
+  quad_tree_shape(tree->quad3, depth + 1, num_nodes, max_depth);
+  quad_tree_shape(tree->quad4, depth + 1, num_nodes, max_depth);
+}
+
 // Inserts a new line into the given linked list
 void insert_line(line_node** lines, line_node* new_line) {
   if (*lines == NULL) {
@@ -70,24 +85,6 @@ void insert_line(line_node** lines, line_node* new_line) {
   }
 }
 
-// Merges the list1 and list2 into list1, does not modify list2
-// Modifies list1
-void merge_lists(line_node** list1, line_node* list2) {
-  if (list2 == NULL) return;
-  if (*list1 == NULL) {
-    *list1 = list2;
-  } else {
-    line_node* node = *list1;
-    line_node* prev = NULL;
-    while (node != NULL) {
-      prev = node;
-      node = node->next;
-    }
-    if (prev != NULL)
-      prev->next = list2;
-  }
-}
-
 // Gets the type of quad that the given line segment can be inserted into
 // If a line cannot be completely inserted into a single quad, a special
 // MUL_TYPE is returned instead.
@@ -127,7 +124,8 @@ int get_quad_type(quad_tree* tree, line_node* node, double timeStep) {
 
 
 // Recursively creates new quadtree nodes and pass the lines down to those node they belong to.
-void quadtree_insert_lines(quad_tree* tree, line_node* new_lines, double timeStep, int num_lines) {
+void quadtree_insert_lines(quad_tree* tree, line_node* new_lines, double timeStep, size_t num_lines, Line** span) {
+  PERF_ATTACH_THREAD();
   tree->num_lines = num_lines;
   double xmax = tree->xmax;
   double xmin = tree->xmin;
@@ -135,14 +133,19 @@ void quadtree_insert_lines(quad_tree* tree, line_node* new_lines, double timeSte
   double ymin = tree->ymin;
 
   if (num_lines <= N) {
-    tree->lines = new_lines;
+    tree->lines = span;
+    tree->num_own_lines = 0;
+    for (line_node* cur = new_lines; cur != NULL; cur = cur->next) {
+      span[tree->num_own_lines++] = cur->line;
+    }
     return;
   }
+  TRACE_BEGIN(trace_mark);
 
   line_node *quad1, *quad2, *quad3, *quad4, *lines;
   quad1 = quad2 = quad3 = quad4 = lines = NULL;
-  int num_quad1, num_quad2, num_quad3, num_quad4, num_parent_lines;
-  num_quad1 = num_quad2 = num_quad3 = num_quad4 = num_lines = 0;
+  size_t num_quad1, num_quad2, num_quad3, num_quad4, num_parent_lines;
+  num_quad1 = num_quad2 = num_quad3 = num_quad4 = num_parent_lines = 0;
 
   line_node* cur = new_lines;
   line_node* next;
@@ -179,22 +182,32 @@ void quadtree_insert_lines(quad_tree* tree, line_node* new_lines, double timeSte
 
   double xmid = (xmin + xmax) / 2.0;
   double ymid = (ymin + ymax) / 2.0;
-  tree->lines = lines;
+  // This node's lines come first in the span, followed by each child's.
+  tree->lines = span;
+  tree->num_own_lines = 0;
+  for (cur = lines; cur != NULL; cur = cur->next) {
+    span[tree->num_own_lines++] = cur->line;
+  }
+  span += num_parent_lines;
 
   if (quad1) {
     tree->quad1 = quad_tree_new(xmin, xmid, ymin, ymid);
-    quadtree_insert_lines(tree->quad1, quad1, timeStep, num_quad1);
+    quadtree_insert_lines(tree->quad1, quad1, timeStep, num_quad1, span);
+    span += num_quad1;
   }
   if (quad2) {
     tree->quad2 = quad_tree_new(xmid, xmax, ymin, ymid);
-    quadtree_insert_lines(tree->quad2, quad2, timeStep, num_quad2);
+    quadtree_insert_lines(tree->quad2, quad2, timeStep, num_quad2, span);
+    span += num_quad2;
   }
   if (quad3) {
     tree->quad3 = quad_tree_new(xmin, xmid, ymid, ymax);
-    quadtree_insert_lines(tree->quad3, quad3, timeStep, num_quad3);
+    quadtree_insert_lines(tree->quad3, quad3, timeStep, num_quad3, span);
+    span += num_quad3;
   }
   if (quad4) {
     tree->quad4 = quad_tree_new(xmid, xmax, ymid, ymax);
-    quadtree_insert_lines(tree->quad4, quad4, timeStep, num_quad4);
+    quadtree_insert_lines(tree->quad4, quad4, timeStep, num_quad4, span);
   }
+  TRACE_END(trace_mark, TRACE_BUILD_SUBTREE, tree->num_lines);
 }
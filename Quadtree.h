@@ -47,15 +47,24 @@ typedef struct line_node line_node;
 
 line_node* line_node_new(Line* line);
 
+// A stack of arrays of lines, innermost span first.  Spans are never modified
+// once made, so stacks can share their tails.
+struct LineSpan {
+  Line** lines;
+  size_t num_lines;
+  const struct LineSpan* next;
+};
+typedef struct LineSpan LineSpan;
+
 // Definition of a node inside a quad tree. Each node contains a list of lines that belong to it.
 struct quad_tree {
   // quad1 is top left, quad2 is top right, quad3 is bottom left and
   // quad4 is bottom right.
   struct quad_tree *quad1, *quad2, *quad3, *quad4;
-  // Head of linked list that contains all line segments stored at that level
-  // of the tree
-  line_node* lines;
+  // Array of all line segments stored at that level of the tree
+  Line** lines;
   size_t num_lines;  // total lines contained, not the length of 'lines'.
+  size_t num_own_lines;  // the length of 'lines'
   // Coordinates of bounding box of the quadtree
   double xmin, xmax, ymin, ymax;
 };
@@ -65,16 +74,20 @@ quad_tree *quad_tree_new(double xmin, double xmax, double ymin, double ymax);
 
 void quad_tree_delete(quad_tree * tree);
 
+// Adds the number of nodes in the tree to *num_nodes and raises *max_depth
+// to the depth of its deepest node, where the given tree is at depth.
+void quad_tree_shape(quad_tree* tree, unsigned int depth,
+                     size_t* num_nodes, unsigned int* max_depth);
+
 // Inserts a new line into the given linked list, making sure that
 // the input line is not modified by this operation in any way
 void insert_line(line_node** lines, line_node* new_line);
 
-// Merges the two lists, does not modify list2
-void merge_lists(line_node** list1, line_node* list2);
-
 int get_quad_type_line(Vec p1, Vec p2, quad_tree* tree);
 int get_quad_type(quad_tree* tree, line_node* node, double timeStep);
 
-void quadtree_insert_lines(quad_tree* tree, line_node* new_lines, double timeStep, int num_lines);
+// Builds the subtree below tree from the list of num_lines lines.  Each node's
+// lines are stored in a part of span, which must have room for num_lines.
+void quadtree_insert_lines(quad_tree* tree, line_node* new_lines, double timeStep, size_t num_lines, Line** span);
 
 #endif  // QUADTREE_H_
@@ -0,0 +1,227 @@
+/**
+ * Query.c -- spatial queries over a quadtree of line segments
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./Query.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "./IntersectionDetection.h"
+
+// Clips the parameter range [*t0, *t1] of a segment against one side of a
+// rectangle, as in the Liang-Barsky algorithm.  Returns false if nothing is
+// left.
+static inline bool clipSide(double p, double q, double* t0, double* t1) {
+  if (p == 0) {
+    return q >= 0;
+  }
+  double r = q / p;
+  if (p < 0) {
+    if (r > *t1) return false;
+    if (r > *t0) *t0 = r;
+  } else {
+    if (r < *t0) return false;
+    if (r < *t1) *t1 = r;
+  }
+  return true;
+}
+
+// Whether the segment (p1, p2) touches the rectangle, boundary included.
+static bool segmentTouchesRect(Vec p1, Vec p2, double xmin, double xmax,
+                               double ymin, double ymax) {
+  double t0 = 0;
+  double t1 = 1;
+  double dx = p2.x - p1.x;
+  double dy = p2.y - p1.y;
+  return clipSide(-dx, p1.x - xmin, &t0, &t1)
+      && clipSide(dx, xmax - p1.x, &t0, &t1)
+      && clipSide(-dy, p1.y - ymin, &t0, &t1)
+      && clipSide(dy, ymax - p1.y, &t0, &t1);
+}
+
+// The region that bounds the lines of a subtree.  Lines are sorted into
+// quadrants by the side of the midlines they lie on, so a quadrant reaches
+// past its node's box wherever the root's box does not hold every line.
+static const QueryRect unboundedRegion = { -INFINITY, INFINITY,
+                                           -INFINITY, INFINITY };
+
+// Splits a node's region into the regions of its children, in the order
+// quad1 to quad4.
+static void splitRegion(quad_tree* tree, const QueryRect* region,
+                        QueryRect children[4]) {
+  double xmid = (tree->xmin + tree->xmax) / 2.0;
+  double ymid = (tree->ymin + tree->ymax) / 2.0;
+  for (int c = 0; c < 4; c++) {
+    children[c] = *region;
+    if (c % 2 == 0) {
+      children[c].xmax = xmid;
+    } else {
+      children[c].xmin = xmid;
+    }
+    if (c < 2) {
+      children[c].ymax = ymid;
+    } else {
+      children[c].ymin = ymid;
+    }
+  }
+}
+
+static inline bool regionsOverlap(const QueryRect* a, const QueryRect* b) {
+  return a->xmin <= b->xmax && a->xmax >= b->xmin
+      && a->ymin <= b->ymax && a->ymax >= b->ymin;
+}
+
+static inline void addResult(Line* line, Line** results,
+                             size_t maxResults, size_t* count) {
+  if (*count < maxResults) {
+    results[*count] = line;
+  }
+  (*count)++;
+}
+
+static void rectInTree(quad_tree* tree, const QueryRect* region,
+                       const QueryRect* rect, Line** results,
+                       size_t maxResults, size_t* count) {
+  for (size_t i = 0; i < tree->num_own_lines; i++) {
+    Line* line = tree->lines[i];
+    if (segmentTouchesRect(line->p1, line->p2, rect->xmin, rect->xmax,
+                           rect->ymin, rect->ymax)) {
+      addResult(line, results, maxResults, count);
+    }
+  }
+  quad_tree* children[4] = { tree->quad1, tree->quad2, tree->quad3,
+                             tree->quad4 };
+  QueryRect regions[4];
+  splitRegion(tree, region, regions);
+  for (int c = 0; c < 4; c++) {
+    if (children[c] != NULL && regionsOverlap(&regions[c], rect)) {
+      rectInTree(children[c], &regions[c], rect, results, maxResults, count);
+    }
+  }
+}
+
+size_t Query_rect(quad_tree* tree, const QueryRect* rect,
+                  Line** results, size_t maxResults) {
+  size_t count = 0;
+  rectInTree(tree, &unboundedRegion, rect, results, maxResults, &count);
+  return count;
+}
+
+static void segmentInTree(quad_tree* tree, const QueryRect* region,
+                          const QuerySegment* segment, Line** results,
+                          size_t maxResults, size_t* count) {
+  for (size_t i = 0; i < tree->num_own_lines; i++) {
+    Line* line = tree->lines[i];
+    if (intersectLines(segment->p1, segment->p2, line->p1, line->p2)) {
+      addResult(line, results, maxResults, count);
+    }
+  }
+  quad_tree* children[4] = { tree->quad1, tree->quad2, tree->quad3,
+                             tree->quad4 };
+  QueryRect regions[4];
+  splitRegion(tree, region, regions);
+  for (int c = 0; c < 4; c++) {
+    if (children[c] != NULL
+        && segmentTouchesRect(segment->p1, segment->p2, regions[c].xmin,
+                              regions[c].xmax, regions[c].ymin,
+                              regions[c].ymax)) {
+      segmentInTree(children[c], &regions[c], segment, results, maxResults,
+                    count);
+    }
+  }
+}
+
+size_t Query_segment(quad_tree* tree, const QuerySegment* segment,
+                     Line** results, size_t maxResults) {
+  size_t count = 0;
+  segmentInTree(tree, &unboundedRegion, segment, results, maxResults,
+                &count);
+  return count;
+}
+
+static double distanceToSegment(Vec point, Vec a, Vec b) {
+  Vec ab = Vec_subtract(b, a);
+  Vec ap = Vec_subtract(point, a);
+  double length2 = ab.x * ab.x + ab.y * ab.y;
+  double t = (length2 > 0) ? (ap.x * ab.x + ap.y * ab.y) / length2 : 0;
+  if (t < 0) t = 0;
+  if (t > 1) t = 1;
+  return Vec_length(Vec_subtract(ap, Vec_multiply(ab, t)));
+}
+
+static double distanceToRegion(Vec point, const QueryRect* region) {
+  double dx = fmax(fmax(region->xmin - point.x, point.x - region->xmax), 0);
+  double dy = fmax(fmax(region->ymin - point.y, point.y - region->ymax), 0);
+  return sqrt(dx * dx + dy * dy);
+}
+
+// Branch and bound: children are visited closest first, and only while they
+// may hold a line no farther than the best so far, so that ties are still
+// broken by id.
+static void nearestInTree(quad_tree* tree, const QueryRect* region,
+                          Vec point, Line** best, double* bestDistance) {
+  for (size_t i = 0; i < tree->num_own_lines; i++) {
+    Line* line = tree->lines[i];
+    double distance = distanceToSegment(point, line->p1, line->p2);
+    if (*best == NULL || distance < *bestDistance
+        || (distance == *bestDistance && line->id < (*best)->id)) {
+      *best = line;
+      *bestDistance = distance;
+    }
+  }
+
+  quad_tree* all[4] = { tree->quad1, tree->quad2, tree->quad3, tree->quad4 };
+  QueryRect regions[4];
+  splitRegion(tree, region, regions);
+  int order[4];
+  double distances[4];
+  int numChildren = 0;
+  for (int c = 0; c < 4; c++) {
+    if (all[c] == NULL || all[c]->num_lines == 0) {
+      continue;
+    }
+    double distance = distanceToRegion(point, &regions[c]);
+    int k = numChildren++;
+    for (; k > 0 && distances[k - 1] > distance; k--) {
+      order[k] = order[k - 1];
+      distances[k] = distances[k - 1];
+    }
+    order[k] = c;
+    distances[k] = distance;
+  }
+  for (int k = 0; k < numChildren && distances[k] <= *bestDistance; k++) {
+    int c = order[k];
+    nearestInTree(all[c], &regions[c], point, best, bestDistance);
+  }
+}
+
+Line* Query_nearest(quad_tree* tree, Vec point, double* distance) {
+  Line* best = NULL;
+  double bestDistance = DBL_MAX;
+  nearestInTree(tree, &unboundedRegion, point, &best, &bestDistance);
+  if (distance != NULL) {
+    *distance = bestDistance;
+  }
+  return best;
+}
@@ -0,0 +1,64 @@
+/**
+ * Query.h -- spatial queries over a quadtree of line segments
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef QUERY_H_
+#define QUERY_H_
+
+#include "./Line.h"
+#include "./Quadtree.h"
+#include "./Vec.h"
+
+// The queries below walk a quad_tree built by build_quadtree.  A node's own
+// lines are always tested, since the root's may lie anywhere, and a child is
+// only entered when its region can hold a result.  None of them allocate, so
+// any number of them may run on the same tree in parallel.
+
+// An axis-aligned rectangle, boundary included.
+struct QueryRect {
+  double xmin, xmax, ymin, ymax;
+};
+typedef struct QueryRect QueryRect;
+
+// The segment from p1 to p2.
+struct QuerySegment {
+  Vec p1, p2;
+};
+typedef struct QuerySegment QuerySegment;
+
+// Stores up to maxResults of the tree's lines that touch rect in results, and
+// returns the number of lines that touch it, which may exceed maxResults.
+size_t Query_rect(quad_tree* tree, const QueryRect* rect,
+                  Line** results, size_t maxResults);
+
+// Stores up to maxResults of the tree's lines that intersectLines reports as
+// crossing segment in results, and returns the number of such lines, which
+// may exceed maxResults.
+size_t Query_segment(quad_tree* tree, const QuerySegment* segment,
+                     Line** results, size_t maxResults);
+
+// Returns the line of the tree closest to point, the one with the lowest id
+// among equally close lines, or NULL if the tree is empty.  If distance is not
+// NULL, the distance to the line is stored in it.
+Line* Query_nearest(quad_tree* tree, Vec point, double* distance);
+
+#endif  // QUERY_H_
@@ -20,13 +20,18 @@
  * SOFTWARE.
  **/
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "./ktiming.h"
 #include "./Line.h"
 #include "./LineDemo.h"
+#include "./PerfCounters.h"
+#include "./PhaseTiming.h"
+#include "./Trace.h"
 
 // The PROFILE_BUILD preprocessor define is used to indicate we are building for
 // profiling, so don't include any graphics or Cilk functions.
@@ -50,12 +55,50 @@ int main(int argc, char *argv[]) {
   bool graphicDemoFlag = false;
 #endif
   bool imageOnlyFlag = false;
-  unsigned int numFrames = 1;
+  uint64_t numFrames = 1;
+  const char* inputFile = NULL;
+  const char* phaseJSONPath = NULL;
+  double deadlineMs = 0.0;
+  bool perfCountersFlag = false;
+  bool statsFlag = false;
+  const char* tracePath = NULL;
+  bool verifyFlag = false;
+  Broadphase broadphase = BROADPHASE_QUADTREE;
+  bool kineticFlag = false;
+  uint64_t reorderInterval = REORDER_INTERVAL;
+  const char* writeHashPath = NULL;
+  const char* checkHashPath = NULL;
+  const char* resumePath = NULL;
+  const char* checkpointPath = NULL;
+  const char* eventLogPath = NULL;
+  const char* replayPath = NULL;
+  extern char *optarg;
   extern int optind;
 
   // Process command line options.
-  while ((optchar = getopt(argc, argv, "gi")) != -1) {
+  while ((optchar = getopt(argc, argv, "b:C:c:d:f:gij:kL:o:PR:r:st:vw:")) != -1) {
     switch (optchar) {
+      case 'b':
+        if (strcmp(optarg, "quadtree") == 0) {
+          broadphase = BROADPHASE_QUADTREE;
+        } else if (strcmp(optarg, "pairlist") == 0) {
+          broadphase = BROADPHASE_PAIR_LIST;
+        } else {
+          printf("Ignoring unknown broadphase: %s\n", optarg);
+        }
+        break;
+      case 'C':
+        checkpointPath = optarg;
+        break;
+      case 'c':
+        checkHashPath = optarg;
+        break;
+      case 'd':
+        deadlineMs = atof(optarg);
+        break;
+      case 'f':
+        inputFile = optarg;
+        break;
       case 'g':
 #ifndef PROFILE_BUILD
         graphicDemoFlag = true;
@@ -67,6 +110,39 @@ int main(int argc, char *argv[]) {
         graphicDemoFlag = true;
 #endif
         break;
+      case 'j':
+        phaseJSONPath = optarg;
+        break;
+      case 'k':
+        kineticFlag = true;
+        break;
+      case 'L':
+        eventLogPath = optarg;
+        break;
+      case 'o':
+        reorderInterval = strtoull(optarg, NULL, 10);
+        break;
+      case 'P':
+        perfCountersFlag = true;
+        break;
+      case 'R':
+        replayPath = optarg;
+        break;
+      case 'r':
+        resumePath = optarg;
+        break;
+      case 's':
+        statsFlag = true;
+        break;
+      case 't':
+        tracePath = optarg;
+        break;
+      case 'v':
+        verifyFlag = true;
+        break;
+      case 'w':
+        writeHashPath = optarg;
+        break;
       default:
         printf("Ignoring unrecognized option: %c\n", optchar);
         continue;
@@ -82,20 +158,99 @@ int main(int argc, char *argv[]) {
 
     // Check to make sure number of arguments is correct.
     if (remaining_args != 1) {
-      printf("Usage: %s [-g] [-i] <numFrames>\n", argv[0]);
+      printf("Usage: %s [-b broadphase] [-C file] [-c file] [-d ms] [-f file] "
+             "[-g] [-i] [-j file] [-k] [-L file] [-o frames] [-P] [-R file] "
+             "[-r file] [-s] [-t file] [-v] [-w file] <numFrames>\n", argv[0]);
+      printf("  -b : find candidate pairs with quadtree (default) or "
+             "pairlist\n");
+      printf("  -C : write a checkpoint to file after the last frame\n");
+      printf("  -c : check per-frame state hashes against file\n");
+      printf("  -d : log every frame that takes longer than ms\n");
+      printf("  -f : read lines from file instead of line.in\n");
       printf("  -g : show graphics\n");
       printf("  -i : show first image only (ignore numFrames)\n");
+      printf("  -j : write per-phase timings as JSON to file\n");
+      printf("  -k : only check the pairs and walls due, event-driven\n");
+      printf("  -L : write every frame's events to a binary log in file\n");
+      printf("  -o : re-sort the lines along a Hilbert curve, if needed, "
+             "every frames frames (0: never, default %u)\n", REORDER_INTERVAL);
+      printf("  -P : count hardware events per phase\n");
+      printf("  -R : replay the events logged in file instead of detecting "
+             "them\n");
+      printf("  -r : resume from the checkpoint in file instead of reading "
+             "lines\n");
+      printf("  -s : print quadtree and pair-test statistics every frame\n");
+      printf("  -t : write a Chrome trace of the parallel tasks to file\n");
+      printf("  -v : check the broadphase against brute force every frame\n");
+      printf("  -w : write per-frame state hashes to file\n");
       exit(-1);
     }
 
-    numFrames = atoi(argv[1]);
-    printf("Number of frames = %u\n", numFrames);
+    numFrames = strtoull(argv[1], NULL, 10);
+    printf("Number of frames = %" PRIu64 "\n", numFrames);
   }
 
   // Create and initialize the Line simulation environment.
   LineDemo *lineDemo = LineDemo_new();
+  if (inputFile != NULL) {
+    LineDemo_setInputFile(lineDemo, inputFile);
+  }
+  if (resumePath != NULL) {
+    LineDemo_setCheckpointFile(lineDemo, resumePath);
+  }
   LineDemo_initLine(lineDemo);
+  if (resumePath != NULL) {
+    printf("Resuming after frame %" PRIu64 "\n", lineDemo->count);
+  }
   LineDemo_setNumFrames(lineDemo, numFrames);
+  LineDemo_setFrameDeadline(lineDemo, (uint64_t) (deadlineMs * 1e6));
+  LineDemo_setPrintStats(lineDemo, statsFlag);
+  CollisionWorld_setBroadphase(lineDemo->collisionWorld, broadphase);
+  CollisionWorld_setKinetic(lineDemo->collisionWorld, kineticFlag);
+  CollisionWorld_setReorderInterval(lineDemo->collisionWorld, reorderInterval);
+  CollisionWorld_setVerifyBroadphase(lineDemo->collisionWorld, verifyFlag);
+  if (writeHashPath != NULL
+      && !LineDemo_writeStateHashes(lineDemo, writeHashPath)) {
+    perror(writeHashPath);
+    exit(1);
+  }
+  if (checkHashPath != NULL
+      && !LineDemo_checkStateHashes(lineDemo, checkHashPath)) {
+    perror(checkHashPath);
+    exit(1);
+  }
+  if (eventLogPath != NULL
+      && !LineDemo_writeEventLog(lineDemo, eventLogPath)) {
+    perror(eventLogPath);
+    exit(1);
+  }
+  if (replayPath != NULL && !LineDemo_replayEventLog(lineDemo, replayPath)) {
+    printf("%s: not an event log starting at frame %" PRIu64
+           " of these lines\n",
+           replayPath, lineDemo->count + 1);
+    exit(1);
+  }
+
+  if (perfCountersFlag) {
+#ifdef PERF_COUNTERS
+    if (!PerfCounters_enable()) {
+      perror("perf_event_open");
+    }
+#else
+    printf("Perf counters are not compiled in; rebuild with PERF_COUNTERS=1\n");
+#endif
+  }
+
+  if (tracePath != NULL) {
+#ifdef TRACE
+    if (!Trace_enable()) {
+      printf("Could not allocate the trace buffers\n");
+      tracePath = NULL;
+    }
+#else
+    printf("Tracing is not compiled in; rebuild with TRACE=1\n");
+#endif
+  }
 
   const clockmark_t start_time = ktiming_getmark();
 
@@ -116,11 +271,51 @@ int main(int argc, char *argv[]) {
   printf("---- RESULTS ----\n");
   printf("Elapsed execution time: %fs\n",
          ktiming_diff_sec(&start_time, &end_time));
-  printf("%u Line-Wall Collisions\n",
+  printf("%" PRIu64 " Line-Wall Collisions\n",
          LineDemo_getNumLineWallCollisions(lineDemo));
-  printf("%u Line-Line Collisions\n",
+  printf("%" PRIu64 " Line-Line Collisions\n",
          LineDemo_getNumLineLineCollisions(lineDemo));
+  if (verifyFlag) {
+    printf("%" PRIu64 " frames failed broadphase verification\n",
+           CollisionWorld_getNumBroadphaseMismatches(
+               lineDemo->collisionWorld));
+  }
+  if (checkHashPath != NULL) {
+    if (LineDemo_getNumDivergentFrames(lineDemo) == 0) {
+      printf("State hashes match the reference\n");
+    } else {
+      printf("%" PRIu64 " frames diverged from the reference, first at frame %"
+             PRIu64 "\n",
+             LineDemo_getNumDivergentFrames(lineDemo),
+             LineDemo_getFirstDivergentFrame(lineDemo));
+    }
+  }
   printf("---- END RESULTS ----\n");
+  LineDemo_printFrameLatency(lineDemo, stdout);
+  if (checkpointPath != NULL
+      && !LineDemo_saveCheckpoint(lineDemo, checkpointPath)) {
+    perror(checkpointPath);
+  }
+
+#ifdef PHASE_TIMING
+  PhaseTiming_report(stdout);
+#ifdef PERF_COUNTERS
+  PerfCounters_report(stdout);
+#endif
+  if (phaseJSONPath != NULL && !PhaseTiming_writeJSON(phaseJSONPath)) {
+    perror(phaseJSONPath);
+  }
+#ifdef TRACE
+  if (tracePath != NULL && !Trace_write(tracePath)) {
+    perror(tracePath);
+  }
+#endif
+  PhaseTiming_free();
+#else
+  if (phaseJSONPath != NULL) {
+    printf("Phase timing is not compiled in; rebuild with PHASE_TIMING=1\n");
+  }
+#endif
 
   // delete objects
   LineDemo_delete(lineDemo);
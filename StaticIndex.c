@@ -0,0 +1,509 @@
+/**
+ * StaticIndex.c -- spatial index of the lines that do not move
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./StaticIndex.h"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+
+// Slack, in box units, for the rounding of a slow line's position from frame
+// to frame.
+#define STATIC_INDEX_SLACK (8 * DBL_EPSILON)
+
+StaticIndex* StaticIndex_new(size_t capacity) {
+  StaticIndex* index = calloc(1, sizeof(StaticIndex));
+  if (index == NULL) {
+    return NULL;
+  }
+  index->isStatic = malloc(capacity * sizeof(bool));
+  index->isSlow = malloc(capacity * sizeof(bool));
+  index->firstCellX = malloc(capacity * sizeof(size_t));
+  index->firstCellY = malloc(capacity * sizeof(size_t));
+  index->staticLines = malloc(capacity * sizeof(size_t));
+  index->dynamicLines = malloc(capacity * sizeof(size_t));
+  index->slowLines = malloc(capacity * sizeof(size_t));
+  index->capacity = capacity;
+  index->valid = false;
+  if (index->isStatic == NULL || index->isSlow == NULL
+      || index->firstCellX == NULL
+      || index->firstCellY == NULL || index->staticLines == NULL
+      || index->dynamicLines == NULL || index->slowLines == NULL) {
+    StaticIndex_delete(index);
+    return NULL;
+  }
+  return index;
+}
+
+void StaticIndex_delete(StaticIndex* index) {
+  if (index == NULL) {
+    return;
+  }
+  free(index->isStatic);
+  free(index->isSlow);
+  free(index->firstCellX);
+  free(index->firstCellY);
+  free(index->staticLines);
+  free(index->dynamicLines);
+  free(index->cellStart);
+  free(index->cellLines);
+  free(index->staticEvents);
+  free(index->slowLines);
+  free(index->slowPairs);
+  free(index);
+}
+
+bool StaticIndex_isValid(const StaticIndex* index, size_t numLines) {
+  return index->valid && index->numLines == numLines
+      && (index->numSlow == 0 || index->age < STATIC_INDEX_MAX_FRAMES);
+}
+
+bool StaticIndex_canStay(const StaticIndex* index, size_t i) {
+  assert(index->isStatic[i]);
+  const Line* line = index->lines[i];
+  if (!index->isSlow[i]) {
+    return line->velocity.x == 0 && line->velocity.y == 0;
+  }
+  return fabs(line->velocity.x) <= STATIC_INDEX_MAX_SPEED
+      && fabs(line->velocity.y) <= STATIC_INDEX_MAX_SPEED;
+}
+
+// Drops the cached intersections and the slow pairs of static line i.
+static void dropPairs(StaticIndex* index, size_t i) {
+  size_t numKept = 0;
+  for (size_t e = 0; e < index->numStaticEvents; e++) {
+    StaticEvent* event = &index->staticEvents[e];
+    if (event->i1 != i && event->i2 != i) {
+      index->staticEvents[numKept++] = *event;
+    }
+  }
+  index->numStaticEvents = numKept;
+  numKept = 0;
+  for (size_t p = 0; p < index->numSlowPairs; p++) {
+    StaticPair* pair = &index->slowPairs[p];
+    if (pair->i1 != i && pair->i2 != i) {
+      index->slowPairs[numKept++] = *pair;
+    }
+  }
+  index->numSlowPairs = numKept;
+}
+
+void StaticIndex_wake(StaticIndex* index, size_t i) {
+  assert(index->isStatic[i]);
+  index->isStatic[i] = false;
+  index->dynamicLines[index->numDynamic++] = i;
+  index->numStatic--;
+  if (2 * index->numStatic < index->numBuiltStatic) {
+    index->valid = false;
+  }
+  dropPairs(index, i);
+}
+
+void StaticIndex_addLine(StaticIndex* index, size_t numLines) {
+  assert(index->valid && numLines == index->numLines + 1);
+  assert(numLines <= index->capacity);
+  size_t i = index->numLines;
+  index->isStatic[i] = false;
+  index->isSlow[i] = false;
+  index->dynamicLines[index->numDynamic++] = i;
+  index->numLines = numLines;
+}
+
+// Drops i from the first *count of slots, keeping the others in order, and
+// renames last to i.
+static void removeSlot(size_t* slots, size_t* count, size_t i, size_t last) {
+  size_t numKept = 0;
+  for (size_t s = 0; s < *count; s++) {
+    if (slots[s] != i) {
+      slots[numKept++] = (slots[s] == last) ? i : slots[s];
+    }
+  }
+  *count = numKept;
+}
+
+void StaticIndex_removeLine(StaticIndex* index, size_t i, size_t last) {
+  assert(i <= last);
+  if (!index->valid || index->numLines != last + 1) {
+    return;
+  }
+  if (index->isStatic[i]) {
+    dropPairs(index, i);
+    index->numStatic--;
+  }
+  removeSlot(index->staticLines, &index->numBuiltStatic, i, last);
+  removeSlot(index->dynamicLines, &index->numDynamic, i, last);
+  removeSlot(index->slowLines, &index->numSlow, i, last);
+
+  // The cells are compacted in place, each starting where the previous one
+  // now ends.
+  size_t numCells = index->numCells * index->numCells;
+  size_t* cellStart = index->cellStart;
+  size_t numKept = 0;
+  size_t begin = 0;
+  for (size_t c = 0; c < numCells; c++) {
+    size_t end = cellStart[c + 1];
+    cellStart[c] = numKept;
+    for (size_t a = begin; a < end; a++) {
+      size_t j = index->cellLines[a];
+      if (j != i) {
+        index->cellLines[numKept++] = (j == last) ? i : j;
+      }
+    }
+    begin = end;
+  }
+  cellStart[numCells] = numKept;
+  index->numCellLines = numKept;
+
+  for (size_t e = 0; e < index->numStaticEvents; e++) {
+    StaticEvent* event = &index->staticEvents[e];
+    event->i1 = (event->i1 == last) ? i : event->i1;
+    event->i2 = (event->i2 == last) ? i : event->i2;
+  }
+  for (size_t p = 0; p < index->numSlowPairs; p++) {
+    StaticPair* pair = &index->slowPairs[p];
+    pair->i1 = (pair->i1 == last) ? i : pair->i1;
+    pair->i2 = (pair->i2 == last) ? i : pair->i2;
+  }
+  index->isStatic[i] = index->isStatic[last];
+  index->isSlow[i] = index->isSlow[last];
+  index->firstCellX[i] = index->firstCellX[last];
+  index->firstCellY[i] = index->firstCellY[last];
+  index->numLines = last;
+}
+
+bool StaticIndex_grow(StaticIndex* index, size_t capacity) {
+  assert(capacity >= index->capacity);
+  // As in KineticEngine_grow, the arrays that did grow are kept.
+  bool* isStatic = realloc(index->isStatic, capacity * sizeof(bool));
+  if (isStatic != NULL) {
+    index->isStatic = isStatic;
+  }
+  bool* isSlow = realloc(index->isSlow, capacity * sizeof(bool));
+  if (isSlow != NULL) {
+    index->isSlow = isSlow;
+  }
+  size_t* firstCellX = realloc(index->firstCellX, capacity * sizeof(size_t));
+  if (firstCellX != NULL) {
+    index->firstCellX = firstCellX;
+  }
+  size_t* firstCellY = realloc(index->firstCellY, capacity * sizeof(size_t));
+  if (firstCellY != NULL) {
+    index->firstCellY = firstCellY;
+  }
+  size_t* staticLines = realloc(index->staticLines,
+                                capacity * sizeof(size_t));
+  if (staticLines != NULL) {
+    index->staticLines = staticLines;
+  }
+  size_t* dynamicLines = realloc(index->dynamicLines,
+                                 capacity * sizeof(size_t));
+  if (dynamicLines != NULL) {
+    index->dynamicLines = dynamicLines;
+  }
+  size_t* slowLines = realloc(index->slowLines, capacity * sizeof(size_t));
+  if (slowLines != NULL) {
+    index->slowLines = slowLines;
+  }
+  if (isStatic == NULL || isSlow == NULL || firstCellX == NULL || firstCellY == NULL
+      || staticLines == NULL || dynamicLines == NULL || slowLines == NULL) {
+    return false;
+  }
+  index->capacity = capacity;
+  return true;
+}
+
+void StaticIndex_rebase(StaticIndex* index, Line** lines) {
+  index->lines = lines;
+}
+
+// Returns the grid cell along one axis that holds the coordinate.
+// Coordinates outside the box fall into the border cells.
+static inline size_t cellOf(double coordinate, double min,
+                            double cellSize, size_t numCells) {
+  double cell = (coordinate - min) / cellSize;
+  if (!(cell > 0)) {
+    return 0;
+  }
+  if (cell >= numCells - 1) {
+    return numCells - 1;
+  }
+  return (size_t) cell;
+}
+
+// Finds the grid cells reached by the box of static line i, grown for a slow
+// line by the distance it can drift before the index expires.  Collisions
+// can change a slow line's velocity, so the drift is at the largest speed.
+static void findCells(const StaticIndex* index, size_t i, double timeStep,
+                      size_t* x0, size_t* x1, size_t* y0, size_t* y1) {
+  const Line* line = index->lines[i];
+  double drift = index->isSlow[i]
+      ? STATIC_INDEX_MAX_FRAMES
+          * (STATIC_INDEX_MAX_SPEED * timeStep + STATIC_INDEX_SLACK)
+      : 0;
+  size_t numCells = index->numCells;
+  *x0 = cellOf(line->l_x - drift, BOX_XMIN, index->cellWidth, numCells);
+  *x1 = cellOf(line->u_x + drift, BOX_XMIN, index->cellWidth, numCells);
+  *y0 = cellOf(line->l_y - drift, BOX_YMIN, index->cellHeight, numCells);
+  *y1 = cellOf(line->u_y + drift, BOX_YMIN, index->cellHeight, numCells);
+}
+
+// Returns false, leaving the pairs unchanged, if they cannot grow.
+static bool appendSlowPair(StaticIndex* index, size_t* capacity,
+                           size_t i1, size_t i2) {
+  if (index->numSlowPairs == *capacity) {
+    size_t newCapacity = (*capacity > 0) ? 2 * *capacity : 64;
+    StaticPair* pairs = realloc(index->slowPairs,
+                                newCapacity * sizeof(StaticPair));
+    if (pairs == NULL) {
+      return false;
+    }
+    index->slowPairs = pairs;
+    *capacity = newCapacity;
+  }
+  StaticPair* pair = &index->slowPairs[index->numSlowPairs++];
+  pair->i1 = i1;
+  pair->i2 = i2;
+  return true;
+}
+
+// Returns false, leaving the events unchanged, if they cannot grow.
+static bool appendStaticEvent(StaticIndex* index, size_t* capacity,
+                              size_t i1, size_t i2,
+                              IntersectionType intersectionType) {
+  if (index->numStaticEvents == *capacity) {
+    size_t newCapacity = (*capacity > 0) ? 2 * *capacity : 64;
+    StaticEvent* events = realloc(index->staticEvents,
+                                  newCapacity * sizeof(StaticEvent));
+    if (events == NULL) {
+      return false;
+    }
+    index->staticEvents = events;
+    *capacity = newCapacity;
+  }
+  StaticEvent* event = &index->staticEvents[index->numStaticEvents++];
+  event->i1 = i1;
+  event->i2 = i2;
+  event->intersectionType = intersectionType;
+  return true;
+}
+
+bool StaticIndex_build(StaticIndex* index, Line** lines,
+                       size_t numLines, double timeStep) {
+  assert(numLines <= index->capacity);
+  index->valid = false;
+  index->lines = lines;
+  index->numStatic = 0;
+  index->numDynamic = 0;
+  index->numSlow = 0;
+  for (size_t i = 0; i < numLines; i++) {
+    Line* line = lines[i];
+    index->isStatic[i] = fabs(line->velocity.x) <= STATIC_INDEX_MAX_SPEED
+        && fabs(line->velocity.y) <= STATIC_INDEX_MAX_SPEED;
+    index->isSlow[i] = index->isStatic[i]
+        && (line->velocity.x != 0 || line->velocity.y != 0);
+    if (index->isStatic[i]) {
+      update_box(line, timeStep);
+      index->staticLines[index->numStatic++] = i;
+      if (index->isSlow[i]) {
+        index->slowLines[index->numSlow++] = i;
+      }
+    } else {
+      index->dynamicLines[index->numDynamic++] = i;
+    }
+  }
+
+  size_t numCells =
+      (size_t) sqrt(index->numStatic / STATIC_INDEX_LINES_PER_CELL);
+  if (numCells < 1) {
+    numCells = 1;
+  } else if (numCells > STATIC_INDEX_MAX_CELLS) {
+    numCells = STATIC_INDEX_MAX_CELLS;
+  }
+  index->numCells = numCells;
+  index->cellWidth = ((double) BOX_XMAX - BOX_XMIN) / numCells;
+  index->cellHeight = ((double) BOX_YMAX - BOX_YMIN) / numCells;
+
+  // Count the static lines in each cell, then lay the cells out one after
+  // another.
+  free(index->cellStart);
+  free(index->cellLines);
+  index->cellLines = NULL;
+  index->cellStart = calloc(numCells * numCells + 1, sizeof(size_t));
+  if (index->cellStart == NULL) {
+    return false;
+  }
+  size_t* cellStart = index->cellStart;
+  for (size_t s = 0; s < index->numStatic; s++) {
+    size_t i = index->staticLines[s];
+    size_t x0, x1, y0, y1;
+    findCells(index, i, timeStep, &x0, &x1, &y0, &y1);
+    index->firstCellX[i] = x0;
+    index->firstCellY[i] = y0;
+    for (size_t y = y0; y <= y1; y++) {
+      for (size_t x = x0; x <= x1; x++) {
+        cellStart[y * numCells + x + 1]++;
+      }
+    }
+  }
+  for (size_t c = 0; c < numCells * numCells; c++) {
+    cellStart[c + 1] += cellStart[c];
+  }
+  index->numCellLines = cellStart[numCells * numCells];
+  index->cellLines = malloc(index->numCellLines * sizeof(size_t));
+  size_t* cursor = malloc(numCells * numCells * sizeof(size_t));
+  if (index->cellLines == NULL || cursor == NULL) {
+    free(cursor);
+    return false;
+  }
+  for (size_t c = 0; c < numCells * numCells; c++) {
+    cursor[c] = cellStart[c];
+  }
+  for (size_t s = 0; s < index->numStatic; s++) {
+    size_t i = index->staticLines[s];
+    size_t x0, x1, y0, y1;
+    findCells(index, i, timeStep, &x0, &x1, &y0, &y1);
+    for (size_t y = y0; y <= y1; y++) {
+      for (size_t x = x0; x <= x1; x++) {
+        index->cellLines[cursor[y * numCells + x]++] = i;
+      }
+    }
+  }
+  free(cursor);
+
+  // Test every pair of static lines that share a cell, in the first cell
+  // they share.  The pairs involving slow lines are kept to be tested every
+  // frame instead.
+  size_t eventCapacity = 0;
+  free(index->staticEvents);
+  index->staticEvents = NULL;
+  index->numStaticEvents = 0;
+  size_t pairCapacity = 0;
+  free(index->slowPairs);
+  index->slowPairs = NULL;
+  index->numSlowPairs = 0;
+  for (size_t y = 0; y < numCells; y++) {
+    for (size_t x = 0; x < numCells; x++) {
+      size_t c = y * numCells + x;
+      for (size_t a = cellStart[c]; a < cellStart[c + 1]; a++) {
+        size_t i = index->cellLines[a];
+        for (size_t b = a + 1; b < cellStart[c + 1]; b++) {
+          size_t j = index->cellLines[b];
+          size_t firstX = (index->firstCellX[i] > index->firstCellX[j])
+              ? index->firstCellX[i] : index->firstCellX[j];
+          size_t firstY = (index->firstCellY[i] > index->firstCellY[j])
+              ? index->firstCellY[i] : index->firstCellY[j];
+          if (firstX != x || firstY != y) {
+            continue;
+          }
+          size_t i1 = i;
+          size_t i2 = j;
+          if (compareLines(lines[i1], lines[i2]) >= 0) {
+            i1 = j;
+            i2 = i;
+          }
+          if (index->isSlow[i1] || index->isSlow[i2]) {
+            if (!appendSlowPair(index, &pairCapacity, i1, i2)) {
+              return false;
+            }
+            continue;
+          }
+          IntersectionType intersectionType =
+              intersect(lines[i1], lines[i2], timeStep);
+          if (intersectionType != NO_INTERSECTION
+              && !appendStaticEvent(index, &eventCapacity, i1, i2,
+                                    intersectionType)) {
+            return false;
+          }
+        }
+      }
+    }
+  }
+
+  index->numBuiltStatic = index->numStatic;
+  index->numLines = numLines;
+  index->age = 0;
+  index->valid = true;
+  index->numBuilds++;
+  return true;
+}
+
+void StaticIndex_refresh(StaticIndex* index, double timeStep) {
+  for (size_t s = 0; s < index->numSlow; s++) {
+    size_t i = index->slowLines[s];
+    if (index->isStatic[i]) {
+      update_box(index->lines[i], timeStep);
+    }
+  }
+  index->age++;
+}
+
+void StaticIndex_query(const StaticIndex* index, const Line* line,
+                       StaticIndexVisitor visit, void* arg) {
+  size_t numCells = index->numCells;
+  size_t x0 = cellOf(line->l_x, BOX_XMIN, index->cellWidth, numCells);
+  size_t x1 = cellOf(line->u_x, BOX_XMIN, index->cellWidth, numCells);
+  size_t y0 = cellOf(line->l_y, BOX_YMIN, index->cellHeight, numCells);
+  size_t y1 = cellOf(line->u_y, BOX_YMIN, index->cellHeight, numCells);
+  for (size_t y = y0; y <= y1; y++) {
+    for (size_t x = x0; x <= x1; x++) {
+      size_t c = y * numCells + x;
+      for (size_t a = index->cellStart[c]; a < index->cellStart[c + 1];
+           a++) {
+        size_t i = index->cellLines[a];
+        if (!index->isStatic[i]) {
+          continue;
+        }
+        // Visit the static line only in the first cell both boxes reach.
+        size_t firstX = (index->firstCellX[i] > x0)
+            ? index->firstCellX[i] : x0;
+        size_t firstY = (index->firstCellY[i] > y0)
+            ? index->firstCellY[i] : y0;
+        if (firstX == x && firstY == y) {
+          visit(index->lines[i], arg);
+        }
+      }
+    }
+  }
+}
+
+void StaticIndex_appendStaticEvents(
+    const StaticIndex* index, double timeStep,
+    IntersectionEventList* intersectionEventList) {
+  for (size_t e = 0; e < index->numStaticEvents; e++) {
+    const StaticEvent* event = &index->staticEvents[e];
+    IntersectionEventList_appendNode(intersectionEventList,
+                                     index->lines[event->i1],
+                                     index->lines[event->i2],
+                                     event->intersectionType);
+  }
+  for (size_t p = 0; p < index->numSlowPairs; p++) {
+    Line* l1 = index->lines[index->slowPairs[p].i1];
+    Line* l2 = index->lines[index->slowPairs[p].i2];
+    IntersectionType intersectionType = intersect(l1, l2, timeStep);
+    if (intersectionType != NO_INTERSECTION) {
+      IntersectionEventList_appendNode(intersectionEventList, l1, l2,
+                                       intersectionType);
+    }
+  }
+}
@@ -0,0 +1,184 @@
+/**
+ * StaticIndex.h -- spatial index of the lines that do not move
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef STATICINDEX_H_
+#define STATICINDEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "./IntersectionDetection.h"
+#include "./IntersectionEventList.h"
+#include "./Line.h"
+
+// The grid has about this many static lines per cell, and at most
+// STATIC_INDEX_MAX_CELLS cells per side.
+#define STATIC_INDEX_LINES_PER_CELL 2
+#define STATIC_INDEX_MAX_CELLS 256
+
+// Lines moving at most STATIC_INDEX_MAX_SPEED box units per time step along
+// each axis are static too.  Their cells are grown by the distance they can
+// drift in STATIC_INDEX_MAX_FRAMES frames, after which an index holding any
+// of them is rebuilt.
+#define STATIC_INDEX_MAX_SPEED 1e-6
+#define STATIC_INDEX_MAX_FRAMES 64
+
+// An intersection between two static lines, by their indices in the lines
+// the index was built from.  Precondition:
+// compareLines(lines[i1], lines[i2]) < 0.
+struct StaticEvent {
+  size_t i1, i2;
+  IntersectionType intersectionType;
+};
+typedef struct StaticEvent StaticEvent;
+
+// Two static lines that share a grid cell, ordered as in a StaticEvent.
+struct StaticPair {
+  size_t i1, i2;
+};
+typedef struct StaticPair StaticPair;
+
+// Lines with zero or nearly zero velocity, binned once in a uniform grid over
+// the box.  A static line with zero velocity keeps its position and box until
+// a collision gives it a velocity; a slow one stays within its grown cells
+// until the index expires.  A line that a collision speeds up past
+// STATIC_INDEX_MAX_SPEED, or sets moving when it had zero velocity, is woken:
+// it becomes dynamic and is skipped by the grid, which is only rebuilt once
+// half of its lines have woken.
+struct StaticIndex {
+  // The lines the index was built from.
+  Line** lines;
+
+  // Per line: whether it is static, whether it was slow rather than still
+  // when the index was built, and the first grid cell its box reaches.
+  bool* isStatic;
+  bool* isSlow;
+  size_t* firstCellX;
+  size_t* firstCellY;
+
+  // Indices of the lines that were static when the index was built, the
+  // number of them still static, and the indices of the other lines.
+  size_t* staticLines;
+  size_t numBuiltStatic;
+  size_t numStatic;
+  size_t* dynamicLines;
+  size_t numDynamic;
+
+  // Cell (x, y) holds the static lines whose boxes reach it, in
+  // cellLines[cellStart[y * numCells + x] .. cellStart[y * numCells + x + 1]).
+  size_t numCells;
+  double cellWidth, cellHeight;
+  size_t* cellStart;
+  size_t* cellLines;
+  size_t numCellLines;
+
+  // Intersections among the static lines with zero velocity, which are the
+  // same every frame.
+  StaticEvent* staticEvents;
+  size_t numStaticEvents;
+
+  // Indices of the static lines that move, whose boxes are refreshed every
+  // frame, and the pairs of static lines involving them, which are tested
+  // every frame.
+  size_t* slowLines;
+  size_t numSlow;
+  StaticPair* slowPairs;
+  size_t numSlowPairs;
+
+  // Frames the index was used for since it was built.
+  uint64_t age;
+
+  size_t numLines;
+  size_t capacity;
+  bool valid;
+
+  // Number of builds so far.
+  uint64_t numBuilds;
+};
+typedef struct StaticIndex StaticIndex;
+
+// Called with each static line a query finds.
+typedef void (*StaticIndexVisitor)(Line* staticLine, void* arg);
+
+// Returns an invalid index for up to capacity lines, or NULL if it cannot be
+// allocated.
+StaticIndex* StaticIndex_new(size_t capacity);
+
+// Does nothing if index is NULL.
+void StaticIndex_delete(StaticIndex* index);
+
+// Whether the index was built from numLines lines and does not need a
+// rebuild yet.  An index holding slow lines expires after
+// STATIC_INDEX_MAX_FRAMES frames.
+bool StaticIndex_isValid(const StaticIndex* index, size_t numLines);
+
+// Whether static line i, whose velocity a collision may have changed, can
+// stay static.
+bool StaticIndex_canStay(const StaticIndex* index, size_t i);
+
+// Makes static line i dynamic, appending it to dynamicLines.  Once half of
+// the lines static at the last build have woken, the index is marked as
+// needing a rebuild.
+void StaticIndex_wake(StaticIndex* index, size_t i);
+
+// Appends line numLines - 1 of lines, which was just added, to the valid
+// index built from the lines before it.  The line is dynamic until the next
+// rebuild, whatever its velocity.
+void StaticIndex_addLine(StaticIndex* index, size_t numLines);
+
+// Removes line i from the valid index, into whose slot the line at last was
+// just moved: the entries of line i are dropped and those of the moved line
+// follow it to slot i, keeping the order of dynamicLines.
+void StaticIndex_removeLine(StaticIndex* index, size_t i, size_t last);
+
+// Makes room for up to capacity lines.  Returns false, leaving the capacity
+// unchanged, if the memory cannot be allocated.
+bool StaticIndex_grow(StaticIndex* index, size_t capacity);
+
+// Points the index at the given array, which holds the lines the index was
+// built from at the same indices.
+void StaticIndex_rebase(StaticIndex* index, Line** lines);
+
+// Rebuilds the index from the first numLines of lines.  Refreshes the boxes
+// of the static lines.  Returns false, leaving the index invalid, if memory
+// runs out.
+bool StaticIndex_build(StaticIndex* index, Line** lines,
+                       size_t numLines, double timeStep);
+
+// Refreshes the boxes of the slow static lines for the current frame, and
+// counts the frame towards the index's expiry.
+void StaticIndex_refresh(StaticIndex* index, double timeStep);
+
+// Calls visit once for each line still static in a grid cell that the line's box,
+// which must be up to date, reaches.
+void StaticIndex_query(const StaticIndex* index, const Line* line,
+                       StaticIndexVisitor visit, void* arg);
+
+// Appends the intersections among the static lines to the list: the cached
+// ones, and those found by testing the pairs involving slow lines.
+void StaticIndex_appendStaticEvents(
+    const StaticIndex* index, double timeStep,
+    IntersectionEventList* intersectionEventList);
+
+#endif  // STATICINDEX_H_
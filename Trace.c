@@ -0,0 +1,149 @@
+/**
+ * Trace.c -- Chrome trace export of the parallel task tree
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include "./Trace.h"
+
+#ifdef TRACE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "./Parallel.h"
+
+// Number of intervals each worker keeps.
+#define TRACE_BUFFER_SIZE (1 << 16)
+
+struct TraceEvent {
+  clockmark_t begin;
+  clockmark_t end;
+  size_t num_lines;
+  int kind;
+};
+typedef struct TraceEvent TraceEvent;
+
+// A worker's ring buffer.  Only its worker writes to it.
+struct TraceBuffer {
+  TraceEvent* events;
+  // Number of intervals ever recorded; the next one goes to
+  // events[count % TRACE_BUFFER_SIZE].
+  uint64_t count;
+  char padding[64 - sizeof(TraceEvent*) - sizeof(uint64_t)];
+};
+typedef struct TraceBuffer TraceBuffer;
+
+static bool enabled = false;
+static TraceBuffer* buffers = NULL;
+static int numBuffers = 0;
+static clockmark_t startMark;
+
+static const char* kindName(int kind) {
+  switch (kind) {
+    case TRACE_BUILD_SUBTREE:
+      return "build_subtree";
+    case TRACE_TRAVERSE_TASK:
+      return "traverse_task";
+    default:
+      return Phase_name((Phase) kind);
+  }
+}
+
+bool Trace_enable(void) {
+  numBuffers = Parallel_getNumWorkers();
+  buffers = calloc(numBuffers, sizeof(TraceBuffer));
+  if (buffers == NULL) {
+    return false;
+  }
+  for (int w = 0; w < numBuffers; w++) {
+    buffers[w].events = malloc(TRACE_BUFFER_SIZE * sizeof(TraceEvent));
+    if (buffers[w].events == NULL) {
+      return false;
+    }
+  }
+  startMark = ktiming_getmark();
+  enabled = true;
+  return true;
+}
+
+clockmark_t Trace_begin(void) {
+  return enabled ? ktiming_getmark() : 0;
+}
+
+void Trace_end(clockmark_t begin, int kind, size_t num_lines) {
+  if (!enabled) {
+    return;
+  }
+  int worker = Parallel_getWorkerNumber();
+  if (worker < 0 || worker >= numBuffers) {
+    return;
+  }
+  TraceBuffer* buffer = &buffers[worker];
+  TraceEvent* event = &buffer->events[buffer->count % TRACE_BUFFER_SIZE];
+  event->begin = begin;
+  event->end = ktiming_getmark();
+  event->num_lines = num_lines;
+  event->kind = kind;
+  buffer->count++;
+}
+
+bool Trace_write(const char* path) {
+  if (!enabled) {
+    return false;
+  }
+  FILE* out = fopen(path, "w");
+  if (out == NULL) {
+    return false;
+  }
+
+  fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  bool first = true;
+  for (int w = 0; w < numBuffers; w++) {
+    fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+            "\"tid\": %d, \"args\": {\"name\": \"worker %d\"}}",
+            first ? "" : ",\n", w, w);
+    first = false;
+
+    TraceBuffer* buffer = &buffers[w];
+    uint64_t oldest = (buffer->count > TRACE_BUFFER_SIZE)
+        ? buffer->count - TRACE_BUFFER_SIZE : 0;
+    for (uint64_t i = oldest; i < buffer->count; i++) {
+      TraceEvent* event = &buffer->events[i % TRACE_BUFFER_SIZE];
+      // Chrome expects microseconds.
+      fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"X\", "
+              "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %d",
+              kindName(event->kind), (event->begin - startMark) / 1e3,
+              (event->end - event->begin) / 1e3, w);
+      if (event->kind < NUM_PHASES) {
+        fprintf(out, ", \"cat\": \"phase\"}");
+      } else {
+        fprintf(out, ", \"cat\": \"task\", \"args\": {\"num_lines\": %zu}}",
+                event->num_lines);
+      }
+    }
+  }
+  fprintf(out, "\n]}\n");
+
+  return fclose(out) == 0;
+}
+
+#endif  // TRACE
@@ -0,0 +1,73 @@
+/**
+ * Trace.h -- Chrome trace export of the parallel task tree
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "./ktiming.h"
+#include "./PhaseTiming.h"
+
+// Kinds of traced intervals besides the phases.
+typedef enum {
+  TRACE_BUILD_SUBTREE = NUM_PHASES,  // a spawned quadtree_insert_lines
+  TRACE_TRAVERSE_TASK,               // a task of the planned traversal
+  NUM_TRACE_KINDS
+} TraceKind;
+
+// Tracing is only compiled in when building with TRACE defined
+// ("make TRACE=1", which also turns on PHASE_TIMING), and only records after
+// Trace_enable().
+//
+// Every worker appends to its own fixed-size ring buffer, so recording takes
+// no locks; when a buffer is full the oldest intervals are overwritten.
+#ifdef TRACE
+
+// Allocates a ring buffer for every worker and starts recording.  Returns
+// false if the buffers cannot be allocated.
+bool Trace_enable(void);
+
+// Returns the start mark of an interval, or 0 if tracing is off.
+clockmark_t Trace_begin(void);
+
+// Records an interval of the given kind that started at begin and ends now,
+// on the calling worker.  num_lines is the number of lines the task covers.
+void Trace_end(clockmark_t begin, int kind, size_t num_lines);
+
+// Writes all recorded intervals as Chrome trace-event JSON.  Returns false if
+// the file could not be written.
+bool Trace_write(const char* path);
+
+#define TRACE_BEGIN(mark) clockmark_t mark = Trace_begin()
+#define TRACE_END(mark, kind, num_lines) Trace_end(mark, kind, num_lines)
+
+#else
+
+#define TRACE_BEGIN(mark) ((void) 0)
+#define TRACE_END(mark, kind, num_lines) ((void) 0)
+
+#endif  // TRACE
+
+#endif  // TRACE_H_
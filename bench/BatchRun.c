@@ -0,0 +1,239 @@
+/**
+ * BatchRun.c -- simulate many independent scenes in one process
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+// Simulates every scene given on the command line in its own CollisionWorld
+// and reports the final state of each and the aggregate throughput.  Scenes
+// are independent, so small ones run side by side, one world per task with
+// serial internals (see Parallel_serial); scenes with more lines than the
+// serial threshold are then simulated one at a time with parallel internals.
+//
+// The phase timers, hardware counters and trace of PhaseTiming.h keep one
+// set of process-wide state, which worlds stepped side by side would race
+// on, so the batch runner is not built with them.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../CollisionWorld.h"
+#include "../ktiming.h"
+#include "../Line.h"
+#include "../Parallel.h"
+
+#ifdef PHASE_TIMING
+#error "BatchRun cannot be built with PHASE_TIMING, PERF_COUNTERS or TRACE"
+#endif
+
+#define DEFAULT_NUM_FRAMES 4000
+#define DEFAULT_SERIAL_LINES 4096
+
+struct Scene {
+  const char* path;
+  uint64_t numLines;
+
+  // Results, filled in once the scene is simulated.
+  bool loaded;
+  double seconds;
+  uint64_t numLineWallCollisions;
+  uint64_t numLineLineCollisions;
+  uint64_t hash;
+};
+typedef struct Scene Scene;
+
+static uint64_t numFrames = DEFAULT_NUM_FRAMES;
+
+// Reads the number of lines from the first line of the scene file.  Returns
+// 0 if the file cannot be read or holds more lines than fit in memory.
+static uint64_t readNumLines(const char* path) {
+  FILE* fin = fopen(path, "r");
+  uint64_t numLines = 0;
+  if (fin == NULL) {
+    perror(path);
+    return 0;
+  }
+  if (fscanf(fin, "%" SCNu64, &numLines) != 1
+      || numLines > SIZE_MAX / sizeof(Line)) {
+    numLines = 0;
+  }
+  fclose(fin);
+  return numLines;
+}
+
+// Reads the scene file, which is in the line.in format, into a new world.
+// Returns NULL if the file cannot be read.
+static CollisionWorld* loadScene(const Scene* scene) {
+  FILE* fin = fopen(scene->path, "r");
+  if (fin == NULL) {
+    perror(scene->path);
+    return NULL;
+  }
+  uint64_t numLines = 0;
+  if (fscanf(fin, "%" SCNu64 "\n", &numLines) != 1
+      || numLines != scene->numLines) {
+    fclose(fin);
+    return NULL;
+  }
+  Vec* p1 = malloc(numLines * sizeof(Vec));
+  Vec* p2 = malloc(numLines * sizeof(Vec));
+  Vec* velocities = malloc(numLines * sizeof(Vec));
+  Color* colors = malloc(numLines * sizeof(Color));
+  bool allocated = p1 != NULL && p2 != NULL && velocities != NULL
+      && colors != NULL;
+  size_t i = 0;
+  window_dimension px1, py1, px2, py2, vx, vy;
+  int isGray;
+  while (allocated && i < numLines
+         && fscanf(fin, "(%lf, %lf), (%lf, %lf), %lf, %lf, %d\n", &px1, &py1,
+                   &px2, &py2, &vx, &vy, &isGray) == 7) {
+    windowToBox(&p1[i].x, &p1[i].y, px1, py1);
+    windowToBox(&p2[i].x, &p2[i].y, px2, py2);
+    velocityWindowToBox(&velocities[i].x, &velocities[i].y, vx, vy);
+    colors[i] = (Color) isGray;
+    i++;
+  }
+  fclose(fin);
+
+  CollisionWorld* world = NULL;
+  if (allocated && i == numLines) {
+    world = CollisionWorld_newFromArrays(numLines, p1, p2, velocities,
+                                         colors);
+  }
+  if (allocated && i != numLines) {
+    fprintf(stderr, "%s: expected %" PRIu64 " lines, read %zu\n", scene->path,
+            numLines, i);
+  } else if (world == NULL) {
+    fprintf(stderr, "%s: no memory for %" PRIu64 " lines\n", scene->path,
+            numLines);
+  }
+  free(p1);
+  free(p2);
+  free(velocities);
+  free(colors);
+  return world;
+}
+
+static void simulateScene(void* arg) {
+  Scene* scene = arg;
+  CollisionWorld* world = loadScene(scene);
+  if (world == NULL) {
+    return;
+  }
+  const clockmark_t start = ktiming_getmark();
+  CollisionWorld_step(world, numFrames);
+  const clockmark_t end = ktiming_getmark();
+
+  scene->loaded = true;
+  scene->seconds = ktiming_diff_sec(&start, &end);
+  scene->numLineWallCollisions =
+      CollisionWorld_getNumLineWallCollisions(world);
+  scene->numLineLineCollisions =
+      CollisionWorld_getNumLineLineCollisions(world);
+  scene->hash = CollisionWorld_hashState(world);
+  CollisionWorld_delete(world);
+}
+
+static void simulateSmallScenes(size_t begin, size_t end, void* arg) {
+  Scene** smallScenes = arg;
+  for (size_t i = begin; i < end; i++) {
+    Parallel_serial(simulateScene, smallScenes[i]);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int optchar;
+  uint64_t serialLines = DEFAULT_SERIAL_LINES;
+  extern char *optarg;
+  extern int optind;
+
+  while ((optchar = getopt(argc, argv, "n:t:")) != -1) {
+    switch (optchar) {
+      case 'n':
+        numFrames = strtoull(optarg, NULL, 10);
+        break;
+      case 't':
+        serialLines = strtoull(optarg, NULL, 10);
+        break;
+      default:
+        optind = argc;
+        break;
+    }
+  }
+  if (optind == argc) {
+    printf("Usage: %s [-n numFrames] [-t lines] scene ...\n", argv[0]);
+    printf("  -n : frames to simulate per scene (default %u)\n",
+           DEFAULT_NUM_FRAMES);
+    printf("  -t : largest scene simulated with serial internals "
+           "(default %u)\n", DEFAULT_SERIAL_LINES);
+    exit(-1);
+  }
+
+  int numScenes = argc - optind;
+  Scene* scenes = calloc(numScenes, sizeof(Scene));
+  Scene** smallScenes = malloc(numScenes * sizeof(Scene*));
+  int numSmallScenes = 0;
+  for (int s = 0; s < numScenes; s++) {
+    scenes[s].path = argv[optind + s];
+    scenes[s].numLines = readNumLines(scenes[s].path);
+    if (scenes[s].numLines > 0 && scenes[s].numLines <= serialLines) {
+      smallScenes[numSmallScenes++] = &scenes[s];
+    }
+  }
+
+  const clockmark_t start = ktiming_getmark();
+  Parallel_for(numSmallScenes, 1, simulateSmallScenes, smallScenes);
+  for (int s = 0; s < numScenes; s++) {
+    if (scenes[s].numLines > serialLines) {
+      simulateScene(&scenes[s]);
+    }
+  }
+  const clockmark_t end = ktiming_getmark();
+  const double seconds = ktiming_diff_sec(&start, &end);
+
+  printf("%-32s %8s %10s %10s %8s %8s %16s\n", "scene", "lines", "seconds",
+         "frames/s", "walls", "lines", "hash");
+  int numLoaded = 0;
+  for (int s = 0; s < numScenes; s++) {
+    const Scene* scene = &scenes[s];
+    if (!scene->loaded) {
+      printf("%-32s %8s\n", scene->path, "failed");
+      continue;
+    }
+    numLoaded++;
+    printf("%-32s %8" PRIu64 " %10.3f %10.1f %8" PRIu64 " %8" PRIu64
+           " %016" PRIx64 "\n", scene->path,
+           scene->numLines, scene->seconds,
+           (scene->seconds > 0) ? numFrames / scene->seconds : 0.0,
+           scene->numLineWallCollisions, scene->numLineLineCollisions,
+           scene->hash);
+  }
+  printf("%d scenes, %d workers, %.3f s, %.1f frames/s in aggregate\n",
+         numLoaded, Parallel_getNumWorkers(), seconds,
+         (seconds > 0) ? (double) numLoaded * numFrames / seconds : 0.0);
+
+  free(smallScenes);
+  free(scenes);
+  return (numLoaded == numScenes) ? 0 : 1;
+}
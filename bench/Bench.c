@@ -0,0 +1,339 @@
+/**
+ * Bench.c -- microbenchmarks for the collision kernels
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "../CollisionWorld.h"
+#include "../IntersectionDetection.h"
+#include "../IntersectionEventList.h"
+#include "../ktiming.h"
+#include "../Line.h"
+#include "../Quadtree.h"
+
+// Size of the synthetic inputs
+#define NUM_LINES 4096
+#define NUM_EVENTS 4096
+#define NUM_QUERIES 1024
+#define MAX_QUERY_RESULTS 64
+#define NUM_CHURN 1024
+
+// Defaults for the measurement loop
+#define DEFAULT_WARMUP 3
+#define DEFAULT_REPS 15
+
+// Fixed synthetic inputs, generated once from a fixed seed.
+static Line lines[NUM_LINES];
+static line_node nodes[NUM_LINES];
+static CollisionWorld* world;
+static quad_tree* root;
+static double timeStep;
+static QueryRect queryRects[NUM_QUERIES];
+static Vec queryPoints[NUM_QUERIES];
+static Line* queryResults[NUM_QUERIES * MAX_QUERY_RESULTS];
+static size_t numQueryResults[NUM_QUERIES];
+static uint64_t churnIds[NUM_CHURN];
+
+// Keeps the compiler from discarding the results of the kernels.
+static volatile uint64_t sink;
+
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+// Returns a pseudo-random number in [0, 1).
+static double nextRandom() {
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (seed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Lines are generated in pairs: every odd line is placed close to the line
+// before it, so that about half of the (2i, 2i + 1) pairs get past the
+// bounding box test in intersect().
+static void makeLines() {
+  for (int i = 0; i < NUM_LINES; i++) {
+    window_dimension x1, y1;
+    if (i % 2 == 0) {
+      x1 = 20 + nextRandom() * (WINDOW_WIDTH - 80);
+      y1 = 20 + nextRandom() * (WINDOW_HEIGHT - 80);
+    } else {
+      boxToWindow(&x1, &y1, lines[i - 1].p1.x, lines[i - 1].p1.y);
+      x1 += nextRandom() * 30 - 15;
+      y1 += nextRandom() * 30 - 15;
+    }
+    window_dimension x2 = x1 + nextRandom() * 40;
+    window_dimension y2 = y1 + nextRandom() * 40;
+    window_dimension vx = nextRandom() * 2 - 1;
+    window_dimension vy = nextRandom() * 2 - 1;
+
+    Line* line = &lines[i];
+    windowToBox(&line->p1.x, &line->p1.y, x1, y1);
+    windowToBox(&line->p2.x, &line->p2.y, x2, y2);
+    line->max_x_is_p1 = (line->p1.x > line->p2.x);
+    line->max_y_is_p1 = (line->p1.y > line->p2.y);
+    velocityWindowToBox(&line->velocity.x, &line->velocity.y, vx, vy);
+    line->color = (Color) (i % 2);
+    line->id = i;
+    update_box(line, timeStep);
+
+    nodes[i].line = line;
+    nodes[i].next = NULL;
+  }
+}
+
+static void setup() {
+  world = CollisionWorld_new(NUM_LINES);
+  timeStep = world->timeStep;
+  makeLines();
+  for (int i = 0; i < NUM_LINES; i++) {
+    Line* line = malloc(sizeof(Line));
+    *line = lines[i];
+    CollisionWorld_addLine(world, line);
+  }
+  root = quad_tree_new(BOX_XMIN, BOX_XMAX, BOX_YMIN, BOX_YMAX);
+  for (int q = 0; q < NUM_QUERIES; q++) {
+    window_dimension x = nextRandom() * (WINDOW_WIDTH - 40);
+    window_dimension y = nextRandom() * (WINDOW_HEIGHT - 40);
+    QueryRect* rect = &queryRects[q];
+    windowToBox(&rect->xmin, &rect->ymin, x, y);
+    windowToBox(&rect->xmax, &rect->ymax, x + 40, y + 40);
+    windowToBox(&queryPoints[q].x, &queryPoints[q].y, x, y);
+  }
+}
+
+static void teardown() {
+  quad_tree_delete(root);
+  CollisionWorld_delete(world);
+}
+
+// Each kernel performs one run and returns a value that depends on its
+// results.
+
+static uint64_t benchIntersect() {
+  uint64_t hits = 0;
+  for (int i = 0; i + 1 < NUM_LINES; i += 2) {
+    hits += intersect(&lines[i], &lines[i + 1], timeStep);
+  }
+  for (int i = 0; i + 3 < NUM_LINES; i += 2) {
+    hits += intersect(&lines[i], &lines[i + 3], timeStep);
+  }
+  return hits;
+}
+
+static uint64_t benchGetQuadType() {
+  uint64_t sum = 0;
+  for (int i = 0; i < NUM_LINES; i++) {
+    sum += get_quad_type(root, &nodes[i], timeStep);
+  }
+  return sum;
+}
+
+static uint64_t benchUpdateBox() {
+  for (int i = 0; i < NUM_LINES; i++) {
+    update_box(&lines[i], timeStep);
+  }
+  return (uint64_t) (lines[NUM_LINES - 1].u_x * 1e9);
+}
+
+static uint64_t benchBuildQuadtree() {
+  quad_tree* tree = build_quadtree(world);
+  uint64_t numLines = tree->num_lines;
+  quad_tree_delete(tree);
+  return numLines;
+}
+
+static uint64_t benchGetIntersectionEvents() {
+  quad_tree* tree = build_quadtree(world);
+  IntersectionEventList list =
+      CollisionWorld_getIntersectionEvents(tree, timeStep, NULL, NULL);
+  uint64_t numEvents = list.numIntersections;
+  IntersectionEventList_deleteNodes(&list);
+  quad_tree_delete(tree);
+  return numEvents;
+}
+
+static uint64_t benchEventList() {
+  IntersectionEventList parts[4];
+  for (int p = 0; p < 4; p++) {
+    parts[p] = IntersectionEventList_make();
+  }
+  for (int i = 0; i + 1 < NUM_EVENTS; i++) {
+    IntersectionEventList_appendNode(&parts[i % 4], &lines[i], &lines[i + 1],
+                                     L1_WITH_L2);
+  }
+  for (int p = 1; p < 4; p++) {
+    IntersectionEventList_mergeLists(&parts[0], &parts[p]);
+  }
+  uint64_t numEvents = parts[0].numIntersections;
+  IntersectionEventList_deleteNodes(&parts[0]);
+  return numEvents;
+}
+
+static uint64_t benchQueryRects() {
+  CollisionWorld_queryRects(world, queryRects, NUM_QUERIES, queryResults,
+                            MAX_QUERY_RESULTS, numQueryResults);
+  uint64_t numResults = 0;
+  for (int q = 0; q < NUM_QUERIES; q++) {
+    numResults += numQueryResults[q];
+  }
+  return numResults;
+}
+
+static uint64_t benchQueryNearests() {
+  CollisionWorld_queryNearests(world, queryPoints, NUM_QUERIES, queryResults,
+                               NULL);
+  uint64_t sum = 0;
+  for (int q = 0; q < NUM_QUERIES; q++) {
+    sum += queryResults[q]->id;
+  }
+  return sum;
+}
+
+// Adds NUM_CHURN lines to the world and removes them again, oldest first,
+// so every removal but the last moves a line into the freed slot.
+static uint64_t benchInsertRemove() {
+  for (int i = 0; i < NUM_CHURN; i++) {
+    const Line* line = &lines[i];
+    if (!CollisionWorld_insertLine(world, line->p1, line->p2, line->velocity,
+                                   line->color, &churnIds[i])) {
+      churnIds[i] = UINT64_MAX;
+    }
+  }
+  uint64_t numRemoved = 0;
+  for (int i = 0; i < NUM_CHURN; i++) {
+    numRemoved += CollisionWorld_removeLine(world, churnIds[i]);
+  }
+  return numRemoved;
+}
+
+struct Benchmark {
+  const char* name;
+  uint64_t (*run)();
+  // Number of kernel invocations in one run, used to report time per op.
+  unsigned int opsPerRun;
+};
+typedef struct Benchmark Benchmark;
+
+static const Benchmark benchmarks[] = {
+  { "intersect", benchIntersect, NUM_LINES - 1 },
+  { "get_quad_type", benchGetQuadType, NUM_LINES },
+  { "update_box", benchUpdateBox, NUM_LINES },
+  { "build_quadtree", benchBuildQuadtree, 1 },
+  { "getIntersectionEvents", benchGetIntersectionEvents, 1 },
+  { "event_list_ops", benchEventList, NUM_EVENTS - 1 },
+  { "query_rects", benchQueryRects, NUM_QUERIES },
+  { "query_nearests", benchQueryNearests, NUM_QUERIES },
+  { "insert_remove", benchInsertRemove, 2 * NUM_CHURN },
+};
+
+static int compareDoubles(const void* a, const void* b) {
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+static void runBenchmark(const Benchmark* benchmark, int warmup, int reps) {
+  double* samples = malloc(reps * sizeof(double));
+  if (samples == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < warmup; i++) {
+    sink += benchmark->run();
+  }
+  for (int i = 0; i < reps; i++) {
+    const clockmark_t start = ktiming_getmark();
+    sink += benchmark->run();
+    const clockmark_t end = ktiming_getmark();
+    samples[i] = (double) ktiming_diff_usec(&start, &end)
+        / benchmark->opsPerRun;
+  }
+
+  double mean = 0.0;
+  for (int i = 0; i < reps; i++) {
+    mean += samples[i];
+  }
+  mean /= reps;
+  double variance = 0.0;
+  for (int i = 0; i < reps; i++) {
+    variance += (samples[i] - mean) * (samples[i] - mean);
+  }
+  variance = (reps > 1) ? variance / (reps - 1) : 0.0;
+
+  qsort(samples, reps, sizeof(double), compareDoubles);
+  double median = (reps % 2 == 1) ? samples[reps / 2]
+      : (samples[reps / 2 - 1] + samples[reps / 2]) / 2.0;
+
+  printf("%-22s %10u %12.2f %12.2f %12.2f %12.2f %7.2f%%\n",
+         benchmark->name, benchmark->opsPerRun, median, samples[0], mean,
+         sqrt(variance), (mean > 0.0) ? 100.0 * sqrt(variance) / mean : 0.0);
+  free(samples);
+}
+
+int main(int argc, char *argv[]) {
+  int optchar;
+  int warmup = DEFAULT_WARMUP;
+  int reps = DEFAULT_REPS;
+  extern char *optarg;
+  extern int optind;
+
+  while ((optchar = getopt(argc, argv, "r:w:")) != -1) {
+    switch (optchar) {
+      case 'r':
+        reps = atoi(optarg);
+        break;
+      case 'w':
+        warmup = atoi(optarg);
+        break;
+      default:
+        printf("Usage: %s [-r reps] [-w warmup] [kernel ...]\n", argv[0]);
+        exit(-1);
+    }
+  }
+  if (reps < 1) {
+    reps = 1;
+  }
+
+  setup();
+
+  printf("%-22s %10s %12s %12s %12s %12s %8s\n", "kernel", "ops/run",
+         "median(ns)", "min(ns)", "mean(ns)", "stddev(ns)", "cv");
+  const int numBenchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+  for (int b = 0; b < numBenchmarks; b++) {
+    // Remaining arguments, if any, select the kernels to run.
+    bool selected = (optind == argc);
+    for (int a = optind; a < argc; a++) {
+      if (strcmp(argv[a], benchmarks[b].name) == 0) {
+        selected = true;
+      }
+    }
+    if (selected) {
+      runBenchmark(&benchmarks[b], warmup, reps);
+    }
+  }
+
+  teardown();
+  return 0;
+}
@@ -0,0 +1,118 @@
+/**
+ * GenLines.c -- generate synthetic line.in scenes
+ * Copyright (c) 2012 the Massachusetts Institute of Technology
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ **/
+
+// Writes a scene of n lines in the line.in format to stdout.  The window is
+// split into a grid with one cell per line, and each line is placed at a
+// random position and orientation inside its own cell, so no two lines
+// intersect initially.  Line lengths shrink with the number of lines, so
+// scenes of different sizes have about the same density of interactions.
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../Line.h"
+
+static uint64_t seed = 1;
+
+// Returns a pseudo-random number in [0, 1).
+static double nextRandom() {
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (seed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+int main(int argc, char *argv[]) {
+  int optchar;
+  uint64_t numLines = 0;
+  double maxSpeed = 0.5;
+  double grayFraction = 0.5;
+  double staticFraction = 0.0;
+  extern char *optarg;
+
+  while ((optchar = getopt(argc, argv, "g:n:s:v:z:")) != -1) {
+    switch (optchar) {
+      case 'g':
+        grayFraction = atof(optarg);
+        break;
+      case 'n':
+        numLines = strtoull(optarg, NULL, 10);
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'v':
+        maxSpeed = atof(optarg);
+        break;
+      case 'z':
+        staticFraction = atof(optarg);
+        break;
+      default:
+        break;
+    }
+  }
+  if (numLines == 0) {
+    printf("Usage: %s -n numLines [-s seed] [-v maxSpeed] [-g grayFraction] "
+           "[-z staticFraction]\n", argv[0]);
+    printf("  -v : maximum speed in pixels per time step (default 0.5)\n");
+    printf("  -z : fraction of lines that start with zero velocity\n");
+    exit(-1);
+  }
+
+  // Keep a margin to the walls so that no line starts outside the box.
+  const double margin = 10.0;
+  const double width = WINDOW_WIDTH - 2 * margin;
+  const double height = WINDOW_HEIGHT - 2 * margin;
+  uint64_t cols = (uint64_t) ceil(sqrt(numLines * width / height));
+  uint64_t rows = (numLines + cols - 1) / cols;
+  const double cellWidth = width / cols;
+  const double cellHeight = height / rows;
+  const double cellSize = (cellWidth < cellHeight) ? cellWidth : cellHeight;
+
+  printf("%" PRIu64 "\n", numLines);
+  for (uint64_t i = 0; i < numLines; i++) {
+    double length = cellSize * (0.3 + 0.5 * nextRandom());
+    double angle = nextRandom() * M_PI;
+    double dx = length * cos(angle);
+    double dy = length * sin(angle);
+
+    // Center of the line, jittered so that it stays inside its cell.
+    double cx = margin + (i % cols + 0.5) * cellWidth
+        + (cellWidth - fabs(dx)) * (nextRandom() - 0.5);
+    double cy = margin + (i / cols + 0.5) * cellHeight
+        + (cellHeight - fabs(dy)) * (nextRandom() - 0.5);
+
+    double speed = maxSpeed * nextRandom();
+    double heading = nextRandom() * 2 * M_PI;
+    if (staticFraction > 0 && nextRandom() < staticFraction) {
+      speed = 0;
+    }
+
+    printf("(%f, %f), (%f, %f), %f, %f, %d\n", cx - dx / 2, cy - dy / 2,
+           cx + dx / 2, cy + dy / 2, speed * cos(heading),
+           speed * sin(heading), nextRandom() < grayFraction);
+  }
+  return 0;
+}
@@ -0,0 +1,127 @@
+#!/bin/sh
+# scaling.sh -- strong- and weak-scaling sweeps over the number of workers
+# Copyright (c) 2012 the Massachusetts Institute of Technology
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+# Runs Screensaver once per worker count and writes a CSV with the time,
+# speedup and efficiency of every phase to stdout.
+#
+# Strong scaling simulates the same scene (line.in, or -s scene) for every
+# worker count.  Weak scaling simulates a scene from bench/GenLines with
+# -n lines per worker.  Speedup and efficiency are relative to the first
+# worker count in the sweep; for weak scaling the speedup is the scaled
+# speedup.
+#
+# Screensaver must be built with "make PHASE_TIMING=1", and bench/GenLines
+# with "make bench".  Run from the top of the tree.
+
+usage() {
+  echo "Usage: $0 [-m strong|weak|both] [-w \"1 2 4 8\"] [-f frames]" >&2
+  echo "          [-n linesPerWorker] [-s scene]" >&2
+  exit 1
+}
+
+mode=both
+workers="1 2 4 8"
+frames=1000
+linesPerWorker=800
+scene=line.in
+
+while getopts "f:m:n:s:w:" opt; do
+  case $opt in
+    f) frames=$OPTARG ;;
+    m) mode=$OPTARG ;;
+    n) linesPerWorker=$OPTARG ;;
+    s) scene=$OPTARG ;;
+    w) workers=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+
+case $mode in
+  strong|weak|both) ;;
+  *) usage ;;
+esac
+
+if [ ! -x ./Screensaver ]; then
+  echo "$0: ./Screensaver not found; run \"make PHASE_TIMING=1\"" >&2
+  exit 1
+fi
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# run <mode> <workers> <scene>: appends "mode workers lines phase seconds"
+# records for one run to $tmp/results.
+run() {
+  lines=$(head -n 1 "$3")
+  out=$(PAR_NWORKERS=$2 ./Screensaver -f "$3" -j "$tmp/phases.json" \
+        "$frames") || exit 1
+  if [ ! -s "$tmp/phases.json" ]; then
+    echo "$0: no phase timings; rebuild with \"make PHASE_TIMING=1\"" >&2
+    exit 1
+  fi
+  sed -n 's/^ *"\([A-Za-z]*\)": {"total_sec": \([0-9.e+-]*\),.*/\1 \2/p' \
+      "$tmp/phases.json" |
+    while read -r phase seconds; do
+      echo "$1 $2 $lines $phase $seconds"
+    done >> "$tmp/results"
+  echo "$out" | sed -n 's/^Elapsed execution time: \([0-9.e+-]*\)s$/\1/p' |
+    while read -r seconds; do
+      echo "$1 $2 $lines elapsed $seconds"
+    done >> "$tmp/results"
+  rm -f "$tmp/phases.json"
+}
+
+: > "$tmp/results"
+for w in $workers; do
+  if [ "$mode" != weak ]; then
+    run strong "$w" "$scene"
+  fi
+  if [ "$mode" != strong ]; then
+    if [ ! -x ./bench/GenLines ]; then
+      echo "$0: ./bench/GenLines not found; run \"make bench\"" >&2
+      exit 1
+    fi
+    ./bench/GenLines -n $((linesPerWorker * w)) -s 1 > "$tmp/scene.in"
+    run weak "$w" "$tmp/scene.in"
+  fi
+done
+
+echo "mode,workers,lines,frames,phase,seconds,speedup,efficiency"
+awk -v frames="$frames" '
+  {
+    key = $1 SUBSEP $4
+    if (!(key in baseTime)) {
+      baseTime[key] = $5
+      baseWorkers[key] = $2
+    }
+    ratio = ($5 > 0) ? baseTime[key] / $5 : 0
+    scale = $2 / baseWorkers[key]
+    if ($1 == "strong") {
+      speedup = ratio
+      efficiency = ratio / scale
+    } else {
+      speedup = ratio * scale
+      efficiency = ratio
+    }
+    printf "%s,%d,%d,%d,%s,%.6f,%.3f,%.3f\n", $1, $2, $3, frames, $4, $5,
+           speedup, efficiency
+  }' "$tmp/results" | sort -s -t, -k1,1